@@ -20,6 +20,13 @@ class DistSource {
   virtual void WriteMakeFile(Makefile* out) = 0;
   virtual void WriteMakeClean(Makefile::Rule* out) = 0;
   virtual void WriteMakeHead(const Input& input, Makefile* out) = 0;
+
+  // Files changed in "revisions" (e.g. "HEAD~3..HEAD"), relative to our
+  // root. Returns false if this source does not support revisions.
+  virtual bool ChangedFiles(const std::string& revisions,
+                            std::vector<std::string>* files) {
+    return false;
+  }
 };
 
 }  //  namespace repobuild
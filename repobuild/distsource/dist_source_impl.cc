@@ -63,4 +63,13 @@ void DistSourceImpl::WriteMakeHead(const Input& input, Makefile* out) {
   }
 }
 
+bool DistSourceImpl::ChangedFiles(const string& revisions,
+                                  vector<string>* files) {
+  if (git_tree_.get() == NULL) {
+    LOG(ERROR) << "Revisions require git, see --enable_git_tree.";
+    return false;
+  }
+  return git_tree_->ChangedFiles(revisions, files);
+}
+
 }  //  namespace repobuild
@@ -24,6 +24,8 @@ class DistSourceImpl : public DistSource {
   virtual void WriteMakeFile(Makefile* out);
   virtual void WriteMakeClean(Makefile::Rule* out);
   virtual void WriteMakeHead(const Input& input, Makefile* out);
+  virtual bool ChangedFiles(const std::string& revisions,
+                            std::vector<std::string>* files);
 
  private:
   DISALLOW_COPY_AND_ASSIGN(DistSourceImpl);
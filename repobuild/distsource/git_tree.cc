@@ -4,6 +4,8 @@
 #include <memory>
 #include <string>
 #include <map>
+#include <set>
+#include <vector>
 #include "common/base/init.h"
 #include "common/base/flags.h"
 #include "common/log/log.h"
@@ -33,6 +35,7 @@ using std::map;
 using std::set;
 using std::string;
 using std::unique_ptr;
+using std::vector;
 
 namespace repobuild {
 namespace {
@@ -47,9 +50,15 @@ namespace {
   };
 GIT_FREE(Repo, git_repository, git_repository_free);
 GIT_FREE(Index, git_index, git_index_free);
+GIT_FREE(Object, git_object, git_object_free);
+GIT_FREE(Tree, git_tree, git_tree_free);
+GIT_FREE(Diff, git_diff_list, git_diff_list_free);
 
 typedef unique_ptr<git_repository, GitFree_Repo> ScopedGitRepo;
 typedef unique_ptr<git_index, GitFree_Index> ScopedGitIndex;
+typedef unique_ptr<git_object, GitFree_Object> ScopedGitObject;
+typedef unique_ptr<git_tree, GitFree_Tree> ScopedGitTree;
+typedef unique_ptr<git_diff_list, GitFree_Diff> ScopedGitDiff;
 
 #undef GIT_FREE
 
@@ -80,6 +89,30 @@ git_index* OpenIndex(git_repository* repo) {
   return index.release();
 }
 
+const char* GitError() {
+  return (giterr_last() && giterr_last()->message ?
+          giterr_last()->message : "???");
+}
+
+git_tree* PeelToTree(git_object* object) {
+  git_object* tree = NULL;
+  if (git_object_peel(&tree, object, GIT_OBJ_TREE) != 0) {
+    return NULL;
+  }
+  return reinterpret_cast<git_tree*>(tree);
+}
+
+int RecordDelta(const git_diff_delta* delta, float progress, void* payload) {
+  set<string>* files = static_cast<set<string>*>(payload);
+  if (delta->old_file.path != NULL) {
+    files->insert(delta->old_file.path);
+  }
+  if (delta->new_file.path != NULL) {
+    files->insert(delta->new_file.path);
+  }
+  return 0;
+}
+
 string FlockScript(const string& scratch_dir) {
   const char kFlockScript[] = "flock_script.pl";
   return strings::JoinPath(scratch_dir, kFlockScript);
@@ -181,6 +214,62 @@ void GitTree::RecordFile(const string& path) {
   }
 }
 
+bool GitTree::ChangedFiles(const string& revisions,
+                           vector<string>* files) const {
+  if (data_->repo.get() == NULL) {
+    LOG(ERROR) << "Not a git repository: " << root_dir_;
+    return false;
+  }
+  git_revspec spec;
+  if (git_revparse(&spec, data_->repo.get(), revisions.c_str()) != 0) {
+    LOG(ERROR) << "Bad revision \"" << revisions << "\": " << GitError();
+    return false;
+  }
+  ScopedGitObject from(spec.from), to(spec.to);
+
+  // "a..b" compares two trees, "a" compares a tree with the working
+  // directory (including untracked files).
+  ScopedGitTree from_tree(PeelToTree(from.get()));
+  ScopedGitTree to_tree;
+  if (spec.flags & GIT_REVPARSE_RANGE) {
+    to_tree.reset(PeelToTree(to.get()));
+    if (to_tree.get() == NULL) {
+      LOG(ERROR) << "Could not read tree for " << revisions << ": "
+                 << GitError();
+      return false;
+    }
+  }
+  if (from_tree.get() == NULL) {
+    LOG(ERROR) << "Could not read tree for " << revisions << ": "
+               << GitError();
+    return false;
+  }
+
+  git_diff_options options = GIT_DIFF_OPTIONS_INIT;
+  git_diff_list* diff_ptr = NULL;
+  int error = 0;
+  if (to_tree.get() != NULL) {
+    error = git_diff_tree_to_tree(&diff_ptr, data_->repo.get(),
+                                  from_tree.get(), to_tree.get(), &options);
+  } else {
+    options.flags |= (GIT_DIFF_INCLUDE_UNTRACKED |
+                      GIT_DIFF_RECURSE_UNTRACKED_DIRS);
+    error = git_diff_tree_to_workdir(&diff_ptr, data_->repo.get(),
+                                     from_tree.get(), &options);
+  }
+  ScopedGitDiff diff(diff_ptr);
+  if (error != 0) {
+    LOG(ERROR) << "Could not diff " << revisions << ": " << GitError();
+    return false;
+  }
+
+  // NB: Changes inside submodules show up as the submodule path itself.
+  set<string> changed;
+  git_diff_foreach(diff.get(), &RecordDelta, NULL, NULL, &changed);
+  files->insert(files->end(), changed.begin(), changed.end());
+  return true;
+}
+
 void GitTree::InitializeSubmodule(const string& submodule, GitTree* sub_tree) {
   LOG(INFO) << "Initializing submodule: " << submodule;
   // NB: Why use 'git' here instead of libgit2? This is to avoid requiring
@@ -8,6 +8,7 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 #include "common/base/macros.h"
 #include "repobuild/nodes/makefile.h"
 
@@ -22,6 +23,8 @@ class GitTree {
   bool Initialized() const;
   void ExpandChild(const std::string& path);
   void RecordFile(const std::string& path);
+  bool ChangedFiles(const std::string& revisions,
+                    std::vector<std::string>* files) const;
   void WriteMakeFile(Makefile* out) const;
   void WriteMakeClean(Makefile::Rule* out) const;
   void WriteMakeHead(const Input& input, Makefile* out) const;
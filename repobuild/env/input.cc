@@ -12,7 +12,7 @@
 #include "repobuild/env/input.h"
 #include "repobuild/env/target.h"
 #include "repobuild/reader/buildfile.h"
-#include "repobuild/third_party/json/json.h"
+#include "repobuild/reader/buildfile_reader.h"
 
 DEFINE_bool(add_default_flags, true,
             "If false, we disable the default flags.");
@@ -20,6 +20,69 @@ DEFINE_bool(add_default_flags, true,
 DEFINE_bool(enable_flto_object_files, true,
             "If true, we enable -flto in the default flags.");
 
+DEFINE_bool(cc_thin_archives, false,
+            "If true, each cc_library is linked as a thin archive (ar rcsT) "
+            "of its objects. Targets can override this with "
+            "\"thin_archive\". NB: as with any archive, members that "
+            "nothing references are dropped, use \"alwayslink\" for "
+            "static registration.");
+
+DEFINE_bool(cc_link_response_files, false,
+            "If true, cc_binary/cc_shared_library links read their objects "
+            "and archives from a @response file.");
+
+DEFINE_bool(cc_dev_shared_libraries, false,
+            "Development mode: each cc_library is linked into its own "
+            "shared library under <object_dir>/dev_libs, which binaries "
+            "load through an rpath. Changing a library then only relinks "
+            "its .so. Not for release builds.");
+
+DEFINE_bool(split_dwarf, false,
+            "If true, debug info is compiled with -gsplit-dwarf: it stays "
+            "in .dwo files next to the objects rather than being linked "
+            "into binaries. cc_binary can package it with \"dwp\": true. "
+            "Ignored when the default flags use LTO (the .dwo files of code "
+            "generated at link time would be lost), see --lto_mode and "
+            "--debug.");
+
+DEFINE_string(lto_mode, "full",
+              "Link time optimization used by the default flags (unless "
+              "--debug): \"full\" (-flto), \"thin\" (clang: -flto=thin "
+              "with a ThinLTO cache in <object_dir>/.thinlto-cache, gcc: "
+              "-flto=auto for parallel LTRANS jobs) or \"none\".");
+
+DEFINE_bool(java_compile_server, false,
+            "If true, java libraries are compiled by a long-lived javac "
+            "server (java >= 16), started on demand by the client that "
+            "make runs instead of javac. Falls back to a local javac.");
+
+DEFINE_bool(java_abi_dependencies, false,
+            "If true, java libraries recompile only when the API of a "
+            "dependency (javap -package -s -constants of its classes) "
+            "changes, not on every change to its classes. Note that this "
+            "does not see annotation or generic signature changes.");
+
+DEFINE_bool(java_native_jar, false,
+            "If true, java_jar/java_binary jars are written directly from "
+            "the class directories (sorted, fixed timestamps) by a python3 "
+            "script, and left untouched when their contents did not "
+            "change. Targets with jar flags (-J) always use the jar tool.");
+
+DEFINE_bool(py_zipapp, false,
+            "If true, py_binary is packaged as an executable zip of its "
+            "modules and their precompiled bytecode (python >= 3.7 for "
+            "reproducible .pyc). Otherwise, and for binaries without "
+            "py_default_module or with system_dependencies, it uses "
+            "setuptools and plink.");
+
+DEFINE_bool(go_package_actions, false,
+            "If true, each go_library is compiled by \"go tool compile\" "
+            "into its own archive and go_binary links those, so make "
+            "rebuilds (in parallel) only the packages that changed. "
+            "Requires exactly one go_library per package directory, and "
+            "no go packages other than std that repobuild does not "
+            "build.");
+
 DEFINE_bool(silent_make, true,
             "If false, make prints out commands before execution.");
 
@@ -51,9 +114,29 @@ DEFINE_string(binary_dir, "bin",
 DEFINE_bool(debug, false,
             "If true, we disable optimizations.");
 
+DEFINE_int32(cc_unity_size, 0,
+             "If > 0, cc_library sources are compiled in batches of this "
+             "many files (unity build). Targets can override this with "
+             "\"unity_size\" and opt files out with \"unity_exclude\".");
+
 using std::string;
 
 namespace repobuild {
+namespace {
+enum LtoMode { LTO_NONE, LTO_FULL, LTO_THIN };
+
+LtoMode GetLtoMode() {
+  if (!FLAGS_enable_flto_object_files || FLAGS_lto_mode == "none") {
+    return LTO_NONE;
+  } else if (FLAGS_lto_mode == "full") {
+    return LTO_FULL;
+  } else if (FLAGS_lto_mode == "thin") {
+    return LTO_THIN;
+  }
+  LOG(FATAL) << "Unknown --lto_mode: " << FLAGS_lto_mode;
+  return LTO_NONE;
+}
+}  // anonymous namespace
 
 Input::Input() {
   root_dir_ = FLAGS_root_dir;
@@ -65,6 +148,11 @@ Input::Input() {
   binary_dir_ = FLAGS_binary_dir;
 
   // Default flags.
+  LtoMode lto = GetLtoMode();
+  lto_ = FLAGS_add_default_flags && !FLAGS_debug && lto != LTO_NONE;
+  split_dwarf_ = FLAGS_split_dwarf && !lto_;
+  LOG_IF(WARNING, FLAGS_split_dwarf && lto_)
+      << "--split_dwarf is ignored with link time optimization.";
   if (FLAGS_add_default_flags) {
     // Compiling
     AddFlag("-X", "-std=c++11");
@@ -72,6 +160,9 @@ Input::Input() {
     AddFlag("-C", "clang=-stdlib=libc++");
     AddFlag("-C", "-pthread");
     AddFlag("-C", "-g");
+    if (split_dwarf_) {
+      AddFlag("-C", "-gsplit-dwarf");
+    }
     AddFlag("-C", "-Wall");
     AddFlag("-C", "-Werror");
     AddFlag("-C", "-Wno-sign-compare");
@@ -79,8 +170,11 @@ Input::Input() {
     AddFlag("-C", "gcc=-Wno-error=unused-local-typedefs");
     if (!FLAGS_debug) {
       AddFlag("-C", "-O3");
-      if (FLAGS_enable_flto_object_files) {
+      if (lto == LTO_FULL) {
         AddFlag("-C", "-flto");
+      } else if (lto == LTO_THIN) {
+        AddFlag("-C", "clang=-flto=thin");
+        AddFlag("-C", "gcc=-flto");
       }
     }
     AddFlag("-C", "clang=-Qunused-arguments");
@@ -90,10 +184,22 @@ Input::Input() {
     AddFlag("-L", "clang=-stdlib=libc++");
     AddFlag("-L", "-lpthread");
     AddFlag("-L", "-g");
+    if (split_dwarf_) {
+      AddFlag("-L", "-gsplit-dwarf");
+      AddFlag("-L", "$(LD_GDB_INDEX)");  // see cc_shared_library.cc.
+    }
     if (!FLAGS_debug) {
       AddFlag("-L", "-O3");
-      if (FLAGS_enable_flto_object_files) {
+      if (lto == LTO_FULL) {
         AddFlag("-L", "-flto");
+      } else if (lto == LTO_THIN) {
+        // ThinLTO backends run in parallel by default. The cache makes
+        // relinking after a small change cheap.
+        AddFlag("-L", "clang=-flto=thin");
+        // The cache flag depends on the linker (see cc_shared_library.cc).
+        AddFlag("-L", "clang=$(call THINLTO_CACHE_FLAGS," +
+                strings::JoinPath(object_dir_, ".thinlto-cache") + ")");
+        AddFlag("-L", "gcc=-flto=auto");
       }
     }
     AddFlag("-L", "-L/usr/local/lib");
@@ -103,7 +209,23 @@ Input::Input() {
     AddFlag("-JC", "-g");
   }
 
+  // Needed for correctness, so not part of the default flags above.
+  if (FLAGS_cc_dev_shared_libraries) {
+    AddFlag("-C", "-fPIC");
+    AddFlag("-L", "$(call DEV_SHARED_LDFLAGS,$(CURDIR)/" +
+            strings::JoinPath(object_dir_, "dev_libs") + ")");
+  }
+
   silent_make_ = FLAGS_silent_make;
+  cc_unity_size_ = FLAGS_cc_unity_size;
+  cc_thin_archives_ = FLAGS_cc_thin_archives;
+  cc_link_response_files_ = FLAGS_cc_link_response_files;
+  cc_dev_shared_libraries_ = FLAGS_cc_dev_shared_libraries;
+  java_compile_server_ = FLAGS_java_compile_server;
+  java_abi_dependencies_ = FLAGS_java_abi_dependencies;
+  java_native_jar_ = FLAGS_java_native_jar;
+  py_zipapp_ = FLAGS_py_zipapp;
+  go_package_actions_ = FLAGS_go_package_actions;
 }
 
 const std::vector<std::string>& Input::flags(const std::string& key) const {
@@ -134,22 +256,21 @@ void Input::AddBuildTarget(const TargetInfo& target) {
     if (target.IsAll()) {
       BuildFile* file = new BuildFile(target.build_file());
       // Parse the BUILD into a structured format.
-      string filestr = file::ReadFileToStringOrDie(file->filename());
-      file->Parse(filestr);
+      file->ParseFile();
       for (BuildFileNode* node : file->nodes()) {
-	LOG_IF(FATAL, !node->object().isObject())
+	LOG_IF(FATAL, !node->object().is_object())
           << "Expected json object (file = " << file->filename() << "): "
           << node->object();
-	for (const string& key : node->object().getMemberNames()) {
+	for (int i = 0; i < node->object().size(); ++i) {
+	  const StringPiece& key = node->object().keys()[i];
 	  if (key == "config" || key == "plugin") {
 	    continue;
 	  }
-	  const Json::Value& value = node->object()[key];
-	  const Json::Value& name = value["name"];
-	  LOG_IF(FATAL, name.asString() == "all") <<
+	  const BuildValue& name = node->object().item(i).Get("name");
+	  LOG_IF(FATAL, name.is_string() && name.string_value() == "all") <<
 	    "Invalid node named \"all\" in " << target.build_file();
-	  if (name.isString()) {
-	    string path = target.dir() + ":" + name.asString();
+	  if (name.is_string()) {
+	    string path = target.dir() + ":" + name.string_value().as_string();
 	    AddBuildTarget(TargetInfo::FromUserPath(path));
 	  }
 	}
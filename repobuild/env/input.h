@@ -39,6 +39,17 @@ class Input {
     return build_target_set_.find(target) != build_target_set_.end();
   }
   bool silent_make() const { return silent_make_; }
+  int cc_unity_size() const { return cc_unity_size_; }
+  bool cc_thin_archives() const { return cc_thin_archives_; }
+  bool cc_link_response_files() const { return cc_link_response_files_; }
+  bool split_dwarf() const { return split_dwarf_; }
+  bool lto() const { return lto_; }  // default flags compile with -flto.
+  bool cc_dev_shared_libraries() const { return cc_dev_shared_libraries_; }
+  bool java_compile_server() const { return java_compile_server_; }
+  bool java_abi_dependencies() const { return java_abi_dependencies_; }
+  bool java_native_jar() const { return java_native_jar_; }
+  bool py_zipapp() const { return py_zipapp_; }
+  bool go_package_actions() const { return go_package_actions_; }
 
  private:
   std::string root_dir_;
@@ -54,6 +65,17 @@ class Input {
   std::map<std::string, std::vector<std::string> > flags_;
 
   bool silent_make_;
+  int cc_unity_size_;
+  bool cc_thin_archives_;
+  bool cc_link_response_files_;
+  bool split_dwarf_;
+  bool lto_;
+  bool cc_dev_shared_libraries_;
+  bool java_compile_server_;
+  bool java_abi_dependencies_;
+  bool java_native_jar_;
+  bool py_zipapp_;
+  bool go_package_actions_;
 };
 
 }  // namespace repobuild
@@ -0,0 +1,143 @@
+// Copyright 2013
+// Author: Christopher Van Arsdale
+
+#include <fnmatch.h>
+#include <map>
+#include <queue>
+#include <set>
+#include <string>
+#include <vector>
+#include "common/log/log.h"
+#include "common/strings/path.h"
+#include "common/strings/strutil.h"
+#include "common/util/stl.h"
+#include "repobuild/distsource/dist_source.h"
+#include "repobuild/env/input.h"
+#include "repobuild/generator/affected_targets.h"
+#include "repobuild/nodes/allnodes.h"
+#include "repobuild/nodes/node.h"
+#include "repobuild/reader/parser.h"
+#include "repobuild/third_party/json/json.h"
+
+using std::map;
+using std::queue;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace repobuild {
+namespace {
+
+string CleanFile(const string& file) {
+  string out = file;
+  while (strings::HasPrefix(out, "./")) {
+    out = out.substr(2);
+  }
+  while (strings::HasSuffix(out, "/")) {
+    out.resize(out.size() - 1);
+  }
+  return out;
+}
+
+// True if "changed" could alter what "glob" matches or refers to. Changes
+// to a directory (e.g. a git submodule) cover everything under it.
+bool GlobTouches(const string& glob, const string& changed) {
+  return (glob == changed ||
+          strings::HasPrefix(glob, changed + "/") ||
+          fnmatch(glob.c_str(), changed.c_str(), FNM_PATHNAME) == 0);
+}
+
+bool OwnsFile(const Node* node, const set<string>& changed) {
+  if (ContainsKey(changed, CleanFile(node->target().build_file()))) {
+    return true;
+  }
+  set<string> globs;
+  node->SourceGlobs(&globs);
+  for (const string& raw_glob : globs) {
+    string glob = CleanFile(raw_glob);
+    for (const string& file : changed) {
+      if (GlobTouches(glob, file)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+}  // anonymous namespace
+
+AffectedTargets::AffectedTargets(DistSource* source)
+    : source_(source) {
+}
+
+AffectedTargets::~AffectedTargets() {
+}
+
+string AffectedTargets::Generate(const Input& input,
+                                 const vector<string>& changed_files) {
+  NodeBuilderSet builder_set;
+  Parser parser(&builder_set, source_);
+  parser.Parse(input);
+
+  set<string> changed;
+  for (const string& file : changed_files) {
+    if (!file.empty()) {
+      changed.insert(CleanFile(file));
+    }
+  }
+
+  // Reverse dependency index.
+  map<const Node*, vector<const Node*> > parents;
+  for (const Node* node : parser.all_nodes()) {
+    for (const Node* dep : node->dependencies()) {
+      parents[dep].push_back(node);
+    }
+  }
+
+  // Seed with the owners of changed files, then walk up.
+  set<const Node*> affected;
+  queue<const Node*> to_process;
+  for (const Node* node : parser.all_nodes()) {
+    if (OwnsFile(node, changed) && affected.insert(node).second) {
+      to_process.push(node);
+    }
+  }
+  while (!to_process.empty()) {
+    const Node* node = to_process.front();
+    to_process.pop();
+    for (const Node* parent : parents[node]) {
+      if (affected.insert(parent).second) {
+        to_process.push(parent);
+      }
+    }
+  }
+
+  // Only report things the user asked for.
+  set<string> targets, tests;
+  for (const Node* node : parser.input_nodes()) {
+    if (!ContainsKey(affected, node)) {
+      continue;
+    }
+    if (node->IncludeInTests()) {
+      node->TopTests(Node::NO_LANG, &tests);
+    } else {
+      targets.insert(node->target().make_path());
+    }
+  }
+  VLOG(1) << affected.size() << " of " << parser.all_nodes().size()
+          << " nodes affected by " << changed.size() << " files.";
+
+  Json::Value root(Json::objectValue);
+  root["targets"] = Json::Value(Json::arrayValue);
+  for (const string& target : targets) {
+    root["targets"].append(target);
+  }
+  root["tests"] = Json::Value(Json::arrayValue);
+  for (const string& test : tests) {
+    root["tests"].append(test);
+  }
+  Json::StyledWriter writer;
+  return writer.write(root);
+}
+
+}  // namespace repobuild
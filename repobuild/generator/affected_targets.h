@@ -0,0 +1,39 @@
+// Copyright 2013
+// Author: Christopher Van Arsdale
+//
+// AffectedTargets
+//  Given a list of changed files, figures out which of the input targets
+//  need to be rebuilt and which tests need to be re-run. A target is
+//  affected if it owns one of the files (it globbed for it, or it is defined
+//  in that BUILD file), or if it depends on an affected target.
+//
+// Output is json, e.g.:
+//  { "targets": [ "path/to/lib" ], "tests": [ "path/to/lib_test.test" ] }
+// which are make targets for the generated Makefile.
+
+#ifndef _REPOBUILD_GENERATOR_AFFECTED_TARGETS_H__
+#define _REPOBUILD_GENERATOR_AFFECTED_TARGETS_H__
+
+#include <string>
+#include <vector>
+
+namespace repobuild {
+
+class DistSource;
+class Input;
+
+class AffectedTargets {
+ public:
+  explicit AffectedTargets(DistSource* source);
+  ~AffectedTargets();
+
+  std::string Generate(const Input& input,
+                       const std::vector<std::string>& changed_files);
+
+ private:
+  DistSource* source_;  // not owned
+};
+
+}  // namespace repobuild
+
+#endif // _REPOBUILD_GENERATOR_AFFECTED_TARGETS_H__
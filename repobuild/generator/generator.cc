@@ -12,6 +12,7 @@
 #include "repobuild/env/input.h"
 #include "repobuild/env/resource.h"
 #include "repobuild/generator/generator.h"
+#include "repobuild/generator/test_runner.h"
 #include "repobuild/nodes/allnodes.h"
 #include "repobuild/nodes/node.h"
 #include "repobuild/reader/parser.h"
@@ -51,7 +52,8 @@ void ExpandNode(const Parser& parser,
 }  // anonymous namespace
 
 Generator::Generator(DistSource* source)
-    : source_(source) {
+    : source_(source),
+      build_cache_(NULL) {
 }
 
 Generator::~Generator() {
@@ -67,9 +69,11 @@ string Generator::GenerateMakefile(const Input& input) {
   out.append("# Auto-generated by repobuild, do not modify directly.\n\n");
   builder_set.WriteMakeHead(input, &out);
   source_->WriteMakeHead(input, &out);
+  TestRunner::WriteMakeHead(input, &out);
 
   // Get our input tree of nodes.
   repobuild::Parser parser(&builder_set, source_);
+  parser.SetBuildFileCache(build_cache_);
   parser.Parse(input);
 
   // Figure out the order we want to write in our Makefile.
@@ -134,14 +138,17 @@ string Generator::GenerateMakefile(const Input& input) {
   }
   out.WriteRule("all", strings::JoinAll(outputs.files(), " "));
 
-  // Write the test rule.
+  // Write the test rules.
   set<string> tests;
+  vector<const Node*> test_nodes;
   for (const Node* node : parser.input_nodes()) {
     if (node->IncludeInTests()) {
       node->FinalTests(Node::NO_LANG, &tests);
+      test_nodes.push_back(node);
     }
   }
   out.WriteRule("tests", strings::JoinAll(tests, " "));
+  TestRunner::WriteMakeFile(input, test_nodes, &out);
 
   // Write the licences rule.
   Makefile::Rule* license_rule = out.StartRawRule("licenses", "");
@@ -159,7 +166,7 @@ string Generator::GenerateMakefile(const Input& input) {
   out.FinishRule(license_rule);
 
   // Not real files:
-  out.append(".PHONY: clean all tests install licenses\n\n");
+  out.append(".PHONY: clean all tests run_tests install licenses\n\n");
 
   // Default build everything.
   out.append(".DEFAULT_GOAL=all\n\n");
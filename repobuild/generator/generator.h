@@ -8,6 +8,7 @@
 
 namespace repobuild {
 
+class BuildFileCache;
 class DistSource;
 class Input;
 class Parser;
@@ -19,8 +20,12 @@ class Generator {
 
   std::string GenerateMakefile(const Input& input);
 
+  // Optional, lets a long running process avoid re-reading BUILD files.
+  void SetBuildFileCache(BuildFileCache* cache) { build_cache_ = cache; }
+
  private:
   DistSource* source_;  // not owned
+  BuildFileCache* build_cache_;  // not owned, may be null.
 };
 
 }  // namespace repobuild
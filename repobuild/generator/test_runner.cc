@@ -0,0 +1,375 @@
+// Copyright 2013
+// Author: Christopher Van Arsdale
+
+#include <set>
+#include <string>
+#include <vector>
+#include "common/base/flags.h"
+#include "common/strings/path.h"
+#include "common/strings/strutil.h"
+#include "repobuild/env/input.h"
+#include "repobuild/env/resource.h"
+#include "repobuild/generator/test_runner.h"
+#include "repobuild/nodes/makefile.h"
+#include "repobuild/nodes/node.h"
+#include "repobuild/third_party/json/json.h"
+
+DEFINE_int32(test_timeout, 300,
+             "Default per-test timeout (seconds) for \"make run_tests\", "
+             "0 means no timeout.");
+
+using std::set;
+using std::string;
+using std::vector;
+
+namespace repobuild {
+namespace {
+string RunnerScript(const Input& input) {
+  return strings::JoinPath(input.genfile_dir(), "test_runner.py");
+}
+
+string ManifestFile(const Input& input) {
+  return strings::JoinPath(input.genfile_dir(), "test_manifest.json");
+}
+
+string SpecJson(const Node::TestSpec& spec) {
+  Json::Value value(Json::objectValue);
+  value["name"] = spec.name;
+  value["binary"] = spec.binary;
+  value["dir"] = spec.dir;
+  value["GEN_DIR"] = spec.gen_dir;
+  value["OBJ_DIR"] = spec.obj_dir;
+  value["SRC_DIR"] = spec.src_dir;
+  value["timeout"] = spec.timeout_secs;
+  value["shards"] = spec.shard_count;
+  value["data"] = Json::Value(Json::arrayValue);
+  for (const string& data : spec.data) {
+    value["data"].append(data);
+  }
+  value["env"] = Json::Value(Json::objectValue);
+  for (const auto& it : spec.env) {
+    value["env"][it.first] = it.second;
+  }
+  Json::FastWriter writer;
+  string json = writer.write(value);
+  return json.substr(0, json.size() - 1);  // trailing newline.
+}
+}  // anonymous namespace
+
+// static
+void TestRunner::WriteMakeHead(const Input& input, Makefile* out) {
+  const char kRunnerScript[] =
+    "# Runs the tests listed on stdin (one json object per line), see\n"
+    "# repobuild/generator/test_runner.cc.\n"
+    "from __future__ import print_function\n"
+    "import hashlib\n"
+    "import json\n"
+    "import os\n"
+    "import shutil\n"
+    "import signal\n"
+    "import string\n"
+    "import subprocess\n"
+    "import sys\n"
+    "import time\n"
+    "from optparse import OptionParser\n"
+    "\n"
+    "\n"
+    "def LoadJson(path, default):\n"
+    "  try:\n"
+    "    with open(path) as f:\n"
+    "      return json.load(f)\n"
+    "  except (IOError, OSError, ValueError):\n"
+    "    return default\n"
+    "\n"
+    "\n"
+    "def WriteJson(path, value):\n"
+    "  if not path:\n"
+    "    return\n"
+    "  if os.path.dirname(path) and not os.path.isdir(os.path.dirname(path)):\n"
+    "    os.makedirs(os.path.dirname(path))\n"
+    "  with open(path + '.tmp', 'w') as f:\n"
+    "    json.dump(value, f, indent=1, sort_keys=True)\n"
+    "  os.rename(path + '.tmp', path)\n"
+    "\n"
+    "\n"
+    "def HashFile(digest, path):\n"
+    "  digest.update(('%s\\0' % path).encode('utf-8'))\n"
+    "  try:\n"
+    "    with open(path, 'rb') as f:\n"
+    "      while True:\n"
+    "        block = f.read(1 << 16)\n"
+    "        if not block:\n"
+    "          break\n"
+    "        digest.update(block)\n"
+    "  except (IOError, OSError):\n"
+    "    digest.update(b'\\0missing')\n"
+    "  digest.update(b'\\0')\n"
+    "\n"
+    "\n"
+    "def CacheKey(test, shard, shards, root):\n"
+    "  # Everything a run depends on: binary, data inputs, BUILD env, shard.\n"
+    "  digest = hashlib.sha1()\n"
+    "  digest.update(json.dumps([test['name'], test.get('dir', ''),\n"
+    "                            sorted(test.get('env', {}).items()),\n"
+    "                            shard, shards]).encode('utf-8'))\n"
+    "  for path in [test['binary']] + sorted(test.get('data', [])):\n"
+    "    HashFile(digest, os.path.join(root, path))\n"
+    "  return digest.hexdigest()\n"
+    "\n"
+    "\n"
+    "def CpuCount():\n"
+    "  try:\n"
+    "    import multiprocessing\n"
+    "    return multiprocessing.cpu_count()\n"
+    "  except (ImportError, NotImplementedError):\n"
+    "    return 1\n"
+    "\n"
+    "\n"
+    "class Run(object):\n"
+    "  def __init__(self, test, shard, shards):\n"
+    "    self.test = test\n"
+    "    self.shard = shard\n"
+    "    self.shards = shards\n"
+    "    self.process = None\n"
+    "    self.start = 0\n"
+    "    self.duration = 0\n"
+    "    self.status = None\n"
+    "    self.log = ''\n"
+    "    self.key = None\n"
+    "    self.cached = False\n"
+    "\n"
+    "  def Name(self):\n"
+    "    if self.shards == 1:\n"
+    "      return self.test['name']\n"
+    "    return '%s (shard %d/%d)' % (self.test['name'], self.shard + 1, self.shards)\n"
+    "\n"
+    "  def Start(self, root, log_dir):\n"
+    "    env = dict(os.environ)\n"
+    "    env['ROOT_DIR'] = root\n"
+    "    for key in ('GEN_DIR', 'OBJ_DIR', 'SRC_DIR'):\n"
+    "      if key in self.test:\n"
+    "        env[key] = os.path.join(root, self.test[key])\n"
+    "    for key, value in sorted(self.test.get('env', {}).items()):\n"
+    "      env[key] = string.Template(value).safe_substitute(env)\n"
+    "    if self.shards > 1:\n"
+    "      for prefix in ('GTEST_', 'TEST_'):\n"
+    "        env[prefix + 'TOTAL_SHARDS'] = str(self.shards)\n"
+    "        env[prefix + 'SHARD_INDEX'] = str(self.shard)\n"
+    "    self.log = os.path.join(log_dir, '%s.%d.log' % (self.test['name'],\n"
+    "                                                    self.shard))\n"
+    "    if not os.path.isdir(os.path.dirname(self.log)):\n"
+    "      os.makedirs(os.path.dirname(self.log))\n"
+    "    with open(self.log, 'w') as log:\n"
+    "      self.process = subprocess.Popen(\n"
+    "          [os.path.join(root, self.test['binary'])],\n"
+    "          cwd=os.path.join(root, self.test.get('dir', '')),\n"
+    "          env=env, stdout=log, stderr=subprocess.STDOUT,\n"
+    "          preexec_fn=os.setsid)\n"
+    "    self.start = time.time()\n"
+    "\n"
+    "  def Kill(self, signum):\n"
+    "    # Each test is its own process group, so this reaches its children.\n"
+    "    try:\n"
+    "      os.killpg(self.process.pid, signum)\n"
+    "    except OSError:\n"
+    "      pass\n"
+    "    self.process.wait()\n"
+    "\n"
+    "  def Poll(self, timeout):\n"
+    "    code = self.process.poll()\n"
+    "    now = time.time()\n"
+    "    if code is None:\n"
+    "      if timeout <= 0 or now - self.start < timeout:\n"
+    "        return False\n"
+    "      self.Kill(signal.SIGKILL)\n"
+    "      self.status = 'TIMEOUT'\n"
+    "    else:\n"
+    "      self.status = 'PASSED' if code == 0 else 'FAILED'\n"
+    "    self.duration = now - self.start\n"
+    "    return True\n"
+    "\n"
+    "  def CachePath(self, cache_dir):\n"
+    "    return os.path.join(cache_dir, self.key[:2], self.key)\n"
+    "\n"
+    "  def LoadCached(self, cache_dir):\n"
+    "    # Only passing runs are cached, failures are always re-run.\n"
+    "    entry = LoadJson(self.CachePath(cache_dir) + '.json', None)\n"
+    "    if not entry or entry.get('status') != 'PASSED':\n"
+    "      return False\n"
+    "    self.status = entry['status']\n"
+    "    self.duration = entry.get('duration', 0)\n"
+    "    self.log = self.CachePath(cache_dir) + '.log'\n"
+    "    self.cached = True\n"
+    "    return True\n"
+    "\n"
+    "  def StoreCached(self, cache_dir):\n"
+    "    if self.status != 'PASSED':\n"
+    "      return\n"
+    "    path = self.CachePath(cache_dir)\n"
+    "    if not os.path.isdir(os.path.dirname(path)):\n"
+    "      os.makedirs(os.path.dirname(path))\n"
+    "    shutil.copyfile(self.log, path + '.log')\n"
+    "    WriteJson(path + '.json', {'name': self.Name(),\n"
+    "                               'status': self.status,\n"
+    "                               'duration': self.duration})\n"
+    "\n"
+    "\n"
+    "def main():\n"
+    "  parser = OptionParser()\n"
+    "  parser.add_option('--jobs', type='int', default=0)\n"
+    "  parser.add_option('--timeout', type='int', default=0)\n"
+    "  parser.add_option('--history', default='')\n"
+    "  parser.add_option('--summary', default='')\n"
+    "  parser.add_option('--log_dir', default='test_logs')\n"
+    "  parser.add_option('--cache_dir', default='')\n"
+    "  (options, _) = parser.parse_args()\n"
+    "\n"
+    "  root = os.getcwd()\n"
+    "  tests = [json.loads(line) for line in sys.stdin.read().splitlines()\n"
+    "           if line.strip()]\n"
+    "  history = LoadJson(options.history, {})\n"
+    "  jobs = options.jobs if options.jobs > 0 else CpuCount()\n"
+    "\n"
+    "  # Longest (historical) first, unknown tests count as longest.\n"
+    "  pending = []\n"
+    "  for test in tests:\n"
+    "    shards = max(1, int(test.get('shards', 1)))\n"
+    "    for shard in range(shards):\n"
+    "      pending.append(Run(test, shard, shards))\n"
+    "  pending.sort(key=lambda run: (\n"
+    "      -history.get(run.test['name'], float('inf')) / run.shards,\n"
+    "      run.test['name'], run.shard))\n"
+    "  pending.reverse()  # pop() from the end.\n"
+    "\n"
+    "  start = time.time()\n"
+    "  running, done = [], []\n"
+    "\n"
+    "  # Tests run in their own process groups (see Run.Start), so they do\n"
+    "  # not see a ^C sent to ours: pass it on before exiting.\n"
+    "  def Interrupt(signum, frame):\n"
+    "    for run in running:\n"
+    "      run.Kill(signum)\n"
+    "    sys.exit(128 + signum)\n"
+    "  signal.signal(signal.SIGINT, Interrupt)\n"
+    "  signal.signal(signal.SIGTERM, Interrupt)\n"
+    "\n"
+    "  while pending or running:\n"
+    "    while pending and len(running) < jobs:\n"
+    "      run = pending.pop()\n"
+    "      if options.cache_dir:\n"
+    "        run.key = CacheKey(run.test, run.shard, run.shards, root)\n"
+    "        if run.LoadCached(options.cache_dir):\n"
+    "          done.append(run)\n"
+    "          print('%-8s %s (cached)' % (run.status, run.Name()))\n"
+    "          continue\n"
+    "      run.Start(root, options.log_dir)\n"
+    "      running.append(run)\n"
+    "    still_running = []\n"
+    "    for run in running:\n"
+    "      timeout = int(run.test.get('timeout', 0)) or options.timeout\n"
+    "      if not run.Poll(timeout):\n"
+    "        still_running.append(run)\n"
+    "        continue\n"
+    "      done.append(run)\n"
+    "      if run.key:\n"
+    "        run.StoreCached(options.cache_dir)\n"
+    "      print('%-8s %s (%.2fs)' % (run.status, run.Name(), run.duration))\n"
+    "      if run.status != 'PASSED':\n"
+    "        with open(run.log) as log:\n"
+    "          sys.stdout.write(log.read())\n"
+    "      sys.stdout.flush()\n"
+    "    if len(still_running) == len(running):\n"
+    "      time.sleep(0.02)\n"
+    "    running[:] = still_running\n"
+    "\n"
+    "  # Per-test results (shards are merged).\n"
+    "  results = {}\n"
+    "  for run in done:\n"
+    "    result = results.setdefault(run.test['name'], {\n"
+    "        'name': run.test['name'], 'status': 'PASSED', 'duration': 0.0,\n"
+    "        'shards': run.shards, 'logs': [], 'cached': True})\n"
+    "    result['duration'] += run.duration\n"
+    "    result['logs'].append(run.log)\n"
+    "    result['cached'] = result['cached'] and run.cached\n"
+    "    if run.status != 'PASSED' and result['status'] != 'TIMEOUT':\n"
+    "      result['status'] = run.status\n"
+    "  for result in results.values():\n"
+    "    if not result['cached']:\n"
+    "      history[result['name']] = result['duration']\n"
+    "  WriteJson(options.history, history)\n"
+    "\n"
+    "  counts = {}\n"
+    "  for result in results.values():\n"
+    "    counts[result['status']] = counts.get(result['status'], 0) + 1\n"
+    "  cached = len([r for r in results.values() if r['cached']])\n"
+    "  WriteJson(options.summary, {\n"
+    "      'tests': sorted(results.values(), key=lambda r: r['name']),\n"
+    "      'passed': counts.get('PASSED', 0),\n"
+    "      'failed': counts.get('FAILED', 0),\n"
+    "      'timed_out': counts.get('TIMEOUT', 0),\n"
+    "      'cached': cached,\n"
+    "      'wall_time': time.time() - start})\n"
+    "  print('%d passed (%d cached), %d failed, %d timed out.' % (\n"
+    "      counts.get('PASSED', 0), cached, counts.get('FAILED', 0),\n"
+    "      counts.get('TIMEOUT', 0)))\n"
+    "  return 0 if len(results) == counts.get('PASSED', 0) else 1\n"
+    "\n"
+    "\n"
+    "if __name__ == '__main__':\n"
+    "  sys.exit(main())\n";
+  out->append("TEST_JOBS ?= 0\n");
+  out->append("TEST_CACHE_DIR ?= " +
+              strings::JoinPath(input.genfile_dir(), "test_cache") + "\n");
+  out->GenerateExecFile("TestRunner", RunnerScript(input), kRunnerScript);
+}
+
+// static
+void TestRunner::WriteMakeFile(const Input& input,
+                               const vector<const Node*>& tests,
+                               Makefile* out) {
+  // Tests we can run directly, and the make targets for everything else.
+  vector<string> manifest;
+  ResourceFileSet deps;
+  set<string> make_tests;
+  for (const Node* node : tests) {
+    vector<Node::TestSpec> specs;
+    node->TestSpecs(&specs);
+    if (specs.empty()) {
+      node->FinalTests(Node::NO_LANG, &make_tests);
+    }
+    for (const Node::TestSpec& spec : specs) {
+      manifest.push_back(Makefile::Escape(SpecJson(spec)));
+      deps.Add(Resource::FromRootPath(spec.binary));
+      for (const string& data : spec.data) {
+        deps.Add(Resource::FromRootPath(data));
+      }
+    }
+  }
+
+  // The manifest is a file rather than a make variable: it grows with the
+  // number of tests, and an exported variable would be copied into the
+  // environment of every recipe.
+  out->GenerateFileIfChanged(ManifestFile(input), manifest);
+
+  Makefile::Rule* rule = out->StartRule(
+      "run_tests",
+      strings::JoinWith(" ",
+                        strings::JoinAll(deps.files(), " "),
+                        strings::JoinAll(make_tests, " "),
+                        RunnerScript(input),
+                        ManifestFile(input)));
+  rule->WriteCommand(strings::Join(
+      "python ", RunnerScript(input),
+      " --jobs=$(TEST_JOBS)",
+      " --timeout=", FLAGS_test_timeout,
+      " --history=", strings::JoinPath(input.genfile_dir(),
+                                       ".test_durations.json"),
+      " --summary=", strings::JoinPath(input.genfile_dir(),
+                                       "test_results.json"),
+      " --log_dir=", strings::JoinPath(input.genfile_dir(), "test_logs"),
+      " --cache_dir=$(TEST_CACHE_DIR)",
+      " < ", ManifestFile(input)));
+  out->FinishRule(rule);
+}
+
+}  // namespace repobuild
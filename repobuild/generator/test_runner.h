@@ -0,0 +1,43 @@
+// Copyright 2013
+// Author: Christopher Van Arsdale
+//
+// TestRunner
+//  Writes the "run_tests" rule. Unlike "tests", which runs each test as a
+//  make rule, this runs test binaries directly (see Node::TestSpecs) with a
+//  pool of TEST_JOBS processes (default: number of cores), longest tests
+//  first based on previous runs, per-test timeouts and gtest style sharding
+//  (GTEST_TOTAL_SHARDS/GTEST_SHARD_INDEX). Results are written as json to
+//  <genfile_dir>/test_results.json.
+//
+// Relevant BUILD attributes (cc_test, py_test, java_test):
+//  "test_timeout": 60  (seconds, default --test_timeout)
+//  "test_shards": 4
+//  "test_data": [ "testdata/*.txt" ]  (runtime inputs, part of the cache key)
+//
+// Passing runs are cached in $(TEST_CACHE_DIR), keyed by a hash of the test
+// binary, its "test_data" files (and --cc_dev_shared_libraries libraries),
+// its environment and shard. Set
+// TEST_CACHE_DIR= (empty) to always re-run.
+
+#ifndef _REPOBUILD_GENERATOR_TEST_RUNNER_H__
+#define _REPOBUILD_GENERATOR_TEST_RUNNER_H__
+
+#include <vector>
+
+namespace repobuild {
+
+class Input;
+class Makefile;
+class Node;
+
+class TestRunner {
+ public:
+  static void WriteMakeHead(const Input& input, Makefile* out);
+  static void WriteMakeFile(const Input& input,
+                            const std::vector<const Node*>& tests,
+                            Makefile* out);
+};
+
+}  // namespace repobuild
+
+#endif // _REPOBUILD_GENERATOR_TEST_RUNNER_H__
@@ -90,8 +90,9 @@ void NodeBuilder::GetAll(std::vector<NodeBuilder*>* nodes) {
   nodes->push_back(new NodeBuilderImpl<ConfigNode>("config"));
   nodes->push_back(new NodeBuilderImpl<GoLibraryNode>("go_library"));
   nodes->push_back(new NodeBuilderImpl<GoBinaryNode>("go_binary"));
-  nodes->push_back(new NodeBuilderImpl<JavaLibraryNode>("java_library"));
-  nodes->push_back(new NodeBuilderImpl<JavaJarNode>("java_jar"));
+  nodes->push_back(new NodeBuilderImplHead<JavaLibraryNode>(
+      "java_library"));
+  nodes->push_back(new NodeBuilderImplHead<JavaJarNode>("java_jar"));
   nodes->push_back(new NodeBuilderImpl<JavaBinaryNode>("java_binary"));
   nodes->push_back(new NodeBuilderImpl<MakeNode>("make"));
   nodes->push_back(new NodeBuilderImpl<PluginNode>("plugin"));
@@ -13,6 +13,7 @@
 #include "repobuild/nodes/autoconf.h"
 #include "repobuild/nodes/gen_sh.h"
 #include "repobuild/nodes/make.h"
+#include "repobuild/nodes/util.h"
 #include "repobuild/reader/buildfile.h"
 
 using std::map;
@@ -56,6 +57,9 @@ void AutoconfNode::Parse(BuildFile* file, const BuildFileNode& input) {
   // Generate the output files.
   GenShNode* gen = NewSubNodeWithCurrentDeps<GenShNode>(file);
   gen->SetMakeName("Autoconf");
+  bool strict_inputs = false;
+  current_reader()->ParseBoolField("strict_inputs", &strict_inputs);
+  gen->SetStrictInputs(strict_inputs);
   
   // Env
   AddConditionalVariable(
@@ -96,8 +100,27 @@ void AutoconfNode::Parse(BuildFile* file, const BuildFileNode& input) {
       Makefile::Escape(configure +
                        " --prefix=/ --cache-file=$GEN_DIR/config.cache ") +
       GetVariable(kConfigureArgs).ref_name();
+  // Configure only reruns if its own inputs changed ("configure_cache").
+  bool configure_cache = true;
+  current_reader()->ParseBoolField("configure_cache", &configure_cache);
+  string command = build_env + " " + configure_cmd;
+  if (configure_cache) {
+    command = NodeUtil::CachedConfigureCommand(
+        GetVariable(kConfigureEnv).ref_name() + " " +
+        GetVariable(kConfigureArgs).ref_name() + " " +
+        Makefile::Escape(configure + " $BASIC_CXXFLAGS $BASIC_CFLAGS "
+                         "$DEP_FLAGS $USER_CXXFLAGS $USER_CFLAGS "
+                         "$LDFLAGS $USER_LDFLAGS"),
+        ".",
+        "-name configure -o -name \"*.ac\" -o -name \"*.in\" "
+        "-o -name \"*.m4\"",
+        "config.status",
+        Makefile::Escape("$GEN_DIR/config.cache"),
+        command,
+        true);
+  }
   vector<Resource> input_files, output_files;
-  gen->Set(build_setup + "; " + build_env + " " + configure_cmd,
+  gen->Set(build_setup + "; " + command,
            "",  // clean
            input_files,
            output_files);
@@ -3,7 +3,6 @@
 //
 // TODO(cvanarsdale): This overalaps with cc_shared_library.
 
-#include <algorithm>
 #include <set>
 #include <string>
 #include <vector>
@@ -23,6 +22,10 @@ namespace repobuild {
 
 void CCBinaryNode::Parse(BuildFile* file, const BuildFileNode& input) {
   CCLibraryNode::Parse(file, input);
+  thin_archive_ = dev_shared_ = false;  // we link our own objects.
+  current_reader()->ParseBoolField("lto", &lto_);
+  current_reader()->ParseBoolField("dwp", &dwp_);
+  pgo_ = current_reader()->ParseStringField("pgo_training", &pgo_training_);
   ResourceFileSet binaries;
   LocalBinaries(NO_LANG, &binaries);
   AddSubNode(new TopSymlinkNode(
@@ -32,12 +35,6 @@ void CCBinaryNode::Parse(BuildFile* file, const BuildFileNode& input) {
       binaries));
 }
 
-void CCBinaryNode::LocalWriteMake(Makefile* out) const {
-  CCLibraryNode::LocalWriteMakeInternal(false, out);
-  WriteLink(ObjBinary(), out);
-  WriteBaseUserTarget(out);
-}
-
 /**
  * Adds to "has_tag" each Resource in "fileset" that has "tag".
  * Adds to "no_tag" each Resource in "fileset" that does not have "tag".
@@ -55,52 +52,182 @@ static void Partition(const ResourceFileSet& fileset,
   }
 }
 
-void CCBinaryNode::WriteLink(const Resource& file, Makefile* out) const {
+void CCBinaryNode::LocalWriteMake(Makefile* out) const {
+  CCLibraryNode::LocalWriteMakeInternal(false, out);
+
+  // Our own copy of any ephemeral objects, rebuilt whenever we relink.
+  ResourceFileSet main_objects, ephemeral_objects, normal_objects;
+  ObjectFiles(CPP, &main_objects);
+  Partition(main_objects, "ephemeral", &ephemeral_objects, &normal_objects);
+  ObjectVariant ephemeral;
+  ephemeral.object_dir = strings::JoinPath(
+      input().object_dir(), strings::JoinPath("ephemeral",
+                                              target().make_path()));
+  ephemeral.ephemeral_only = true;
+  ephemeral.ephemeral_dependencies = strings::JoinAll(normal_objects.files(),
+                                                      " ");
   ResourceFileSet objects;
-  ObjectFiles(CPP, &objects);
+  if (!lto_ && input().lto()) {
+    // Our dependencies' objects are LTO bitcode, so skipping link time
+    // optimization means compiling everything we link again, -fno-lto.
+    ObjectVariant no_lto;
+    no_lto.object_dir = strings::JoinPath(
+        input().object_dir(), strings::JoinPath("no-lto",
+                                                target().make_path()));
+    no_lto.compile_flags = "-fno-lto";
+    WriteMakeVariant(CPP, no_lto, &objects, out);
+  } else if (ephemeral_objects.files().empty()) {
+    objects = main_objects;
+  } else {
+    WriteMakeVariant(CPP, ephemeral, &objects, out);
+  }
+  WriteLink(ObjBinary(), objects, "", out);
 
-  ResourceFileSet ephemeral_objects, normal_objects;
-  Partition(objects, "ephemeral", &ephemeral_objects, &normal_objects);
+  // Debug info package (all .dwo files the binary refers to).
+  ResourceFileSet user_deps;
+  if (WritesDwp()) {
+    Makefile::Rule* rule = out->StartRule(ObjDwp().path(),
+                                          ObjBinary().path());
+    rule->WriteUserEcho("Packaging", ObjDwp().path());
+    rule->WriteCommand("$(DWP) -e " + ObjBinary().path() +
+                       " -o " + ObjDwp().path());
+    out->FinishRule(rule);
+    user_deps.Add(ObjDwp());
+  }
+  WriteBaseUserTarget(user_deps, out);
+  if (pgo_) {
+    WritePgo(out);
+  }
+}
 
-  set<string> flags;
-  LinkFlags(CPP, &flags);
+void CCBinaryNode::LocalWriteMakeClean(Makefile::Rule* out) const {
+  if (pgo_) {
+    out->MaybeRemoveSymlink(PgoSymlink().path());
+  }
+}
 
-  // Link rule
-  Makefile::Rule* rule =
-    out->StartRule(file.path(), strings::JoinAll(normal_objects.files(), " "));
+void CCBinaryNode::WritePgo(Makefile* out) const {
+  // Profiles are written/read by the instrumented binary and compiler, so
+  // use absolute paths.
+  string profile_dir = Resource::FromLocalPath(
+      input().genfile_dir(), target().make_path() + ".pgo").path();
+  string abs_profile_dir = "$(CURDIR)/" + profile_dir;
+  Resource trained = Resource::FromLocalPath(profile_dir, ".trained");
 
-  string ephemeral_targets = strings::JoinAll(ephemeral_objects.files(), " ");
-  if (!ephemeral_targets.empty()) {
-    rule->WriteUserEcho("Making ephemeral inputs", ephemeral_targets);
-    rule->WriteCommand("make " + ephemeral_targets);
+  // 1) Instrumented build, everything we link is compiled again.
+  ObjectVariant instrumented;
+  instrumented.object_dir = strings::JoinPath(
+      input().object_dir(), strings::JoinPath("pgo-instr",
+                                              target().make_path()));
+  instrumented.compile_flags = "$(call PGO_GEN_FLAGS," + abs_profile_dir + ")";
+  if (!lto_) {
+    instrumented.compile_flags += " -fno-lto";
   }
+  ResourceFileSet instrumented_objects;
+  WriteMakeVariant(CPP, instrumented, &instrumented_objects, out);
+  Resource instrumented_bin = Resource::FromLocalPath(
+      input().object_dir(), target().make_path() + ".pgo-instr");
+  WriteLink(instrumented_bin, instrumented_objects,
+            instrumented.compile_flags, out);
 
-  rule->WriteUserEcho("Linking", file.path());
+  // 2) Training run, then merge the profiles. gcc names .gcda files after
+  // the (mangled) object path, so we move them to the optimized object
+  // names.
+  Makefile::Rule* rule = out->StartRule(trained.path(),
+                                        instrumented_bin.path());
+  rule->WriteUserEcho("Training", instrumented_bin.path());
+  rule->WriteCommand("rm -rf " + profile_dir);
+  rule->WriteCommand("mkdir -p " + profile_dir);
+  rule->WriteCommand(strings::JoinWith(" ", instrumented_bin.path(),
+                                       pgo_training_));
+  rule->WriteCommand(
+      "if [ \"$(" + string(kCxxGcc) + ")\" = \"1\" ]; then "
+      "for f in " + profile_dir + "/*.gcda; do "
+      "mv -f \"$$f\" "
+      "\"$$(echo \"$$f\" | sed 's,#pgo-instr#,#pgo-opt#,')\"; "
+      "done; "
+      "else "
+      "$(LLVM_PROFDATA) merge -output=" + profile_dir + "/merged.profdata " +
+      profile_dir + "/*.profraw; "
+      "fi");
+  rule->WriteCommand("touch " + trained.path());
+  out->FinishRule(rule);
 
-  // HACK(cvanarsdale):
-  // Sadly order matters to the (gcc) linker. It looks in later object
-  // files to find unresolved symbols. We collect the dependencies
-  // bottom up, so we push resources onto the front of the list so
-  // unencumbered resources end up in the back of the list.
-  string obj_list;
-  vector<Resource> copy = objects.files();
-  std::reverse(copy.begin(), copy.end());
-  for (const Resource& r : copy) {
-    obj_list += " ";
-    bool alwayslink = r.has_tag("alwayslink");
-    if (alwayslink) {
-      obj_list += "$(LD_FORCE_LINK_START) ";
-    }
-    obj_list += r.path();
-    if (alwayslink) {
-      obj_list += " $(LD_FORCE_LINK_END)";
+  // 3) Optimized build using the profile.
+  ObjectVariant optimized;
+  optimized.object_dir = strings::JoinPath(
+      input().object_dir(), strings::JoinPath("pgo-opt",
+                                              target().make_path()));
+  optimized.compile_flags = "$(call PGO_USE_FLAGS," + abs_profile_dir + ")";
+  if (!lto_) {
+    optimized.compile_flags += " -fno-lto";
+  }
+  optimized.dependencies = trained.path();
+  ResourceFileSet optimized_objects;
+  WriteMakeVariant(CPP, optimized, &optimized_objects, out);
+  Resource optimized_bin = Resource::FromLocalPath(
+      input().object_dir(), target().make_path() + ".pgo");
+  WriteLink(optimized_bin, optimized_objects, optimized.compile_flags, out);
+
+  // User target: "make path/to/binary.pgo".
+  out->WriteRootSymlink(PgoSymlink().path(), optimized_bin.path());
+  string user_target = target().make_path() + ".pgo";
+  out->append(user_target + ": " + PgoSymlink().path() + "\n\n");
+  out->append(".PHONY: " + user_target + "\n\n");
+}
+
+bool CCBinaryNode::WritesDwp() const {
+  return dwp_ && input().split_dwarf();
+}
+
+Resource CCBinaryNode::ObjDwp() const {
+  return Resource::FromRootPath(ObjBinary().path() + ".dwp");
+}
+
+Resource CCBinaryNode::PgoSymlink() const {
+  return Resource::FromLocalPath(input().binary_dir(),
+                                 ObjBinary().basename() + ".pgo");
+}
+
+void CCBinaryNode::WriteLink(const Resource& file,
+                             const ResourceFileSet& objects,
+                             const string& extra_flags,
+                             Makefile* out) const {
+  set<string> flags;
+  LinkFlags(CPP, &flags);
+  if (!lto_) {
+    flags.insert("-fno-lto");  // overrides -flto from $(LDFLAGS).
+  }
+
+  // Objects, possibly in a response file.
+  Resource response_file = Resource::FromRootPath(file.path() + ".rsp");
+  string obj_list = WriteLinkInputs(objects, false, response_file, out);
+
+  // Link rule. Development shared libraries are order-only: they are
+  // resolved at load time, so relinking one does not relink us.
+  ResourceFileSet link_deps, dev_shared;
+  for (const Resource& r : objects) {
+    if (r.has_tag("dev_shared")) {
+      dev_shared.Add(r);
+    } else {
+      link_deps.Add(r);
     }
   }
+  Makefile::Rule* rule =
+    out->StartRule(file.path(), strings::JoinAll(link_deps.files(), " "));
+  if (input().cc_link_response_files()) {
+    rule->AddDependency(response_file.path());
+  }
+  if (!dev_shared.files().empty()) {
+    rule->AddDependency("| " + strings::JoinAll(dev_shared.files(), " "));
+  }
+  rule->WriteUserEcho("Linking", file.path());
   rule->WriteCommand("mkdir -p " + file.dirname());
   rule->WriteCommand(strings::JoinWith(
       " ",
       "$(LINK.cc)", obj_list, "-o", file,
-      strings::JoinAll(flags, " ")));
+      strings::JoinAll(flags, " "),
+      extra_flags));
   out->FinishRule(rule);
 }
 
@@ -111,6 +238,12 @@ void CCBinaryNode::LocalWriteMakeInstall(Makefile* base,
   rule->WriteCommand("$(INSTALL_PROGRAM) " +
                      ObjBinary().path() + " $(DESTDIR)$(bindir)/" +
                      ObjBinary().basename());
+  if (WritesDwp()) {
+    rule->AddDependency(ObjDwp().path());
+    rule->WriteCommand("$(INSTALL_DATA) " +
+                       ObjDwp().path() + " $(DESTDIR)$(bindir)/" +
+                       ObjDwp().basename());
+  }
 }
 
 void CCBinaryNode::LocalBinaries(LanguageType lang,
@@ -16,11 +16,15 @@ class CCBinaryNode : public CCLibraryNode {
   CCBinaryNode(const TargetInfo& t,
                const Input& i,
                DistSource* s)
-      : CCLibraryNode(t, i, s) {
+      : CCLibraryNode(t, i, s),
+        lto_(true),
+        pgo_(false),
+        dwp_(false) {
   }
   virtual ~CCBinaryNode() {}
   virtual void Parse(BuildFile* file, const BuildFileNode& input);
   virtual void LocalWriteMake(Makefile* out) const;
+  virtual void LocalWriteMakeClean(Makefile::Rule* out) const;
   virtual void LocalBinaries(LanguageType lang,
                              ResourceFileSet* outputs) const;
   virtual void LocalWriteMakeInstall(Makefile* base,
@@ -32,7 +36,24 @@ class CCBinaryNode : public CCLibraryNode {
   // Helper.
   Resource ObjBinary() const;
 
-  void WriteLink(const Resource& file, Makefile* out) const;
+  void WriteLink(const Resource& file,
+                 const ResourceFileSet& objects,
+                 const std::string& extra_flags,
+                 Makefile* out) const;
+
+  // Profile guided optimization: instrumented build, training run and
+  // the optimized <binary>.pgo.
+  void WritePgo(Makefile* out) const;
+  Resource PgoSymlink() const;
+
+  // Split dwarf: packages our .dwo files (--split_dwarf and "dwp").
+  bool WritesDwp() const;
+  Resource ObjDwp() const;
+
+  bool lto_;  // false: compile and link without -flto, for faster links.
+  bool pgo_;
+  std::string pgo_training_;  // arguments for the training run.
+  bool dwp_;
 };
 
 }  // namespace repobuild
@@ -19,8 +19,12 @@ using std::vector;
 
 namespace repobuild {
 namespace {
-string EmbedScript(const Input& input) {
-  return strings::JoinPath(input.genfile_dir(), "cc_embed.sh");
+// Our generator, compiled from kEmbedSource (below) by the Makefile.
+string EmbedSource(const Input& input) {
+  return strings::JoinPath(input.genfile_dir(), "cc_embed.c");
+}
+string EmbedTool(const Input& input) {
+  return strings::JoinPath(input.object_dir(), "cc_embed");
 }
 string RemoveNonAlpha(const string& input) {
   string base = input;
@@ -34,6 +38,156 @@ string RemoveNonAlpha(const string& input) {
 string VariableName(const Resource& source) {
   return "embed_" + RemoveNonAlpha(source.basename());
 }
+
+// Writes <variable>_data()/_size() for each input file, as string literals
+// or (for large files) as an assembler file that .incbin's them, which
+// costs the compiler nothing.
+const char kEmbedSource[] =
+    "/* cc_embed_data generator (see repobuild/nodes/cc_embed_data.cc).\n"
+    " *\n"
+    " * cc_embed HEADER SOURCE ASM GUARD NAMESPACE_START NAMESPACE_END PREFIX\n"
+    " *          [FILE VARIABLE]...\n"
+    " *\n"
+    " * Writes <VARIABLE>_data() and <VARIABLE>_size() for each FILE.\n"
+    " * If ASM is \"-\" the data is a string literal in SOURCE, otherwise\n"
+    " * ASM is an assembler file that .incbin's each FILE (symbols\n"
+    " * PREFIX<VARIABLE>_start/_end).\n"
+    " */\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "static FILE* Open(const char* path, const char* mode) {\n"
+    "  FILE* f = fopen(path, mode);\n"
+    "  if (f == NULL) {\n"
+    "    perror(path);\n"
+    "    exit(1);\n"
+    "  }\n"
+    "  return f;\n"
+    "}\n"
+    "\n"
+    "/* Writes FILE as a string literal, returns its size. */\n"
+    "static long WriteLiteral(const char* path, FILE* out) {\n"
+    "  static unsigned char buf[1 << 16];\n"
+    "  FILE* in = Open(path, \"rb\");\n"
+    "  long size = 0;\n"
+    "  size_t n, i;\n"
+    "  fputs(\"\\\"\", out);\n"
+    "  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {\n"
+    "    for (i = 0; i < n; ++i) {\n"
+    "      int c = buf[i];\n"
+    "      if ((size + i) % 64 == 0 && size + i > 0) {\n"
+    "        fputs(\"\\\"\\n      \\\"\", out);\n"
+    "      }\n"
+    "      /* NB: escaping '?' avoids trigraphs. */\n"
+    "      if (c == '\"' || c == '\\\\' || c == '?') {\n"
+    "        fputc('\\\\', out);\n"
+    "        fputc(c, out);\n"
+    "      } else if (c >= 32 && c < 127) {\n"
+    "        fputc(c, out);\n"
+    "      } else {\n"
+    "        fprintf(out, \"\\\\%03o\", c);  /* 3 digits, never ambiguous. */\n"
+    "      }\n"
+    "    }\n"
+    "    size += n;\n"
+    "  }\n"
+    "  fputs(\"\\\"\", out);\n"
+    "  if (ferror(in)) {\n"
+    "    perror(path);\n"
+    "    exit(1);\n"
+    "  }\n"
+    "  fclose(in);\n"
+    "  return size;\n"
+    "}\n"
+    "\n"
+    "static void Close(FILE* f, const char* path) {\n"
+    "  if (f != NULL && fclose(f) != 0) {\n"
+    "    perror(path);\n"
+    "    exit(1);\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "int main(int argc, char** argv) {\n"
+    "  const char *header, *source, *asm_file, *guard, *ns_start, *ns_end;\n"
+    "  const char *prefix, *base;\n"
+    "  FILE *h, *cc, *s = NULL;\n"
+    "  int i, incbin;\n"
+    "  if (argc < 8 || (argc - 8) % 2 != 0) {\n"
+    "    fprintf(stderr, \"usage: %s header source asm|- guard \"\n"
+    "            \"namespace_start namespace_end prefix \"\n"
+    "            \"[file variable]...\\n\", argv[0]);\n"
+    "    return 1;\n"
+    "  }\n"
+    "  header = argv[1];\n"
+    "  source = argv[2];\n"
+    "  asm_file = argv[3];\n"
+    "  guard = argv[4];\n"
+    "  ns_start = argv[5];\n"
+    "  ns_end = argv[6];\n"
+    "  prefix = argv[7];\n"
+    "  incbin = (strcmp(asm_file, \"-\") != 0);\n"
+    "  base = strrchr(header, '/');\n"
+    "  base = (base == NULL ? header : base + 1);\n"
+    "\n"
+    "  h = Open(header, \"w\");\n"
+    "  fprintf(h, \"#ifndef %s\\n#define %s\\n\"\n"
+    "          \"#include <cstring>  // size_t\\n%s\\n\",\n"
+    "          guard, guard, ns_start);\n"
+    "  cc = Open(source, \"w\");\n"
+    "  fprintf(cc, \"#include \\\"%s\\\"\\n\", base);\n"
+    "  if (incbin) {\n"
+    "    s = Open(asm_file, \"w\");\n"
+    "    fprintf(s, \"#if defined(__APPLE__)\\n#define SYM(x) _##x\\n\"\n"
+    "            \"  .const\\n#else\\n#define SYM(x) x\\n\"\n"
+    "            \"  .section .rodata\\n#endif\\n\");\n"
+    "    for (i = 8; i < argc; i += 2) {\n"
+    "      fprintf(cc, \"extern \\\"C\\\" const char %s%s_start[], \"\n"
+    "              \"%s%s_end[];\\n\",\n"
+    "              prefix, argv[i + 1], prefix, argv[i + 1]);\n"
+    "      fprintf(s, \"  .globl SYM(%s%s_start)\\n\"\n"
+    "              \"  .globl SYM(%s%s_end)\\n\"\n"
+    "              \"  .balign 16\\n\"\n"
+    "              \"SYM(%s%s_start):\\n\"\n"
+    "              \"  .incbin \\\"%s\\\"\\n\"\n"
+    "              \"SYM(%s%s_end):\\n\"\n"
+    "              \"  .byte 0  /* NUL terminated. */\\n\",\n"
+    "              prefix, argv[i + 1], prefix, argv[i + 1],\n"
+    "              prefix, argv[i + 1], argv[i], prefix, argv[i + 1]);\n"
+    "    }\n"
+    "    fprintf(s, \"#if defined(__ELF__)\\n\"\n"
+    "            \"  .section .note.GNU-stack,\\\"\\\",%%progbits\\n\"\n"
+    "            \"#endif\\n\");\n"
+    "  }\n"
+    "  fprintf(cc, \"%s\\n\", ns_start);\n"
+    "\n"
+    "  for (i = 8; i < argc; i += 2) {\n"
+    "    const char* file = argv[i];\n"
+    "    const char* var = argv[i + 1];\n"
+    "    fprintf(h, \"// Auto generated from %s\\n\"\n"
+    "            \"extern const char* %s_data();\\n\"\n"
+    "            \"extern size_t %s_size();\\n\\n\", file, var, var);\n"
+    "    if (incbin) {\n"
+    "      fprintf(cc, \"const char* %s_data() {\\n\"\n"
+    "              \"  return %s%s_start;\\n}\\n\"\n"
+    "              \"size_t %s_size() {\\n\"\n"
+    "              \"  return %s%s_end - %s%s_start;\\n}\\n\",\n"
+    "              var, prefix, var, var, prefix, var, prefix, var);\n"
+    "    } else {\n"
+    "      long size;\n"
+    "      fprintf(cc, \"const char* %s_data() {\\n  return \", var);\n"
+    "      size = WriteLiteral(file, cc);\n"
+    "      fprintf(cc, \";\\n}\\nsize_t %s_size() {\\n  return %ld;\\n}\\n\",\n"
+    "              var, size);\n"
+    "    }\n"
+    "  }\n"
+    "\n"
+    "  fprintf(h, \"%s\\n#endif  // %s\\n\", ns_end, guard);\n"
+    "  fprintf(cc, \"%s\\n\", ns_end);\n"
+    "  Close(h, header);\n"
+    "  Close(cc, source);\n"
+    "  Close(s, asm_file);\n"
+    "  return 0;\n"
+    "}\n";
 }  // anonymous namespace
 
 class CCEmbedDataNodeRaw : public Node {
@@ -41,7 +195,8 @@ class CCEmbedDataNodeRaw : public Node {
   CCEmbedDataNodeRaw(const TargetInfo& t,
                      const Input& i,
                      DistSource* source)
-      : Node(t, i, source) {
+      : Node(t, i, source),
+        incbin_(false) {
   }
   virtual ~CCEmbedDataNodeRaw() {}
   virtual void ParseWithPath(BuildFile* file,
@@ -66,7 +221,8 @@ class CCEmbedDataNodeRaw : public Node {
     return "\"" + strings::Repeat("} ", namespaces_.size()) + "\"";
   }
 
-  Resource header_file_, source_file_;
+  Resource header_file_, source_file_, asm_file_;
+  bool incbin_;  // data in asm_file_ (.incbin), rather than string literals.
   vector<string> namespaces_;
   vector<Resource> sources_;
 };
@@ -77,6 +233,9 @@ void CCEmbedDataNodeRaw::ParseWithPath(BuildFile* file,
   Node::Parse(file, input);
   current_reader()->ParseRepeatedFiles("files", &sources_);
   current_reader()->ParseRepeatedString("namespace", &namespaces_);
+  current_reader()->ParseBoolField("incbin", &incbin_);
+  asm_file_ = Resource::FromLocalPath(Node::input().genfile_dir(),
+                                      file_path + ".S");
   header_file_ = Resource::FromLocalPath(Node::input().genfile_dir(),
                                          file_path + ".h");
   source_file_ = Resource::FromLocalPath(Node::input().genfile_dir(),
@@ -86,47 +245,43 @@ void CCEmbedDataNodeRaw::ParseWithPath(BuildFile* file,
 void CCEmbedDataNodeRaw::LocalWriteMake(Makefile* out) const {
   Makefile::Rule* rule = out->StartRule(
       header_file_.path(),
-      strings::JoinWith(" ", EmbedScript(input()),
+      strings::JoinWith(" ", EmbedTool(input()),
                         strings::JoinAll(sources_, " ")));
   rule->WriteUserEcho("Embed", target().make_path());
   rule->WriteCommand("mkdir -p " + header_file_.dirname());
 
-  // for f in "input variable" "input2 variable2" ...; do
-  //   echo $f;
-  // done | .gen-files/cc_embed.sh
-  //           out_header out_cpp out_if_guard "namespace_start" "namespace_end"
+  // .gen-obj/cc_embed out_header out_cpp out_asm|- out_if_guard
+  //     "namespace_start" "namespace_end" symbol_prefix
+  //     input variable input2 variable2 ...
   vector<string> inputs;
   for (const Resource& source : sources_) {
-    inputs.push_back("\"" +
-                     strings::JoinWith(
-                         " ",
-                         source.path(),
-                         VariableName(source)) +
-                     "\"");
+    inputs.push_back(source.path());
+    inputs.push_back(VariableName(source));
   }
-  rule->WriteCommand("for f in " + strings::JoinAll(inputs, " ") + "; do"
-                     "  echo $$f;"
-                     "done | " +
-                     strings::JoinWith(
-                         " ",
-                         EmbedScript(input()),
-                         header_file_.path(),
-                         source_file_.path(),
-                         strings::UpperString(
-                             RemoveNonAlpha(StripSpecialDirs(
-                                 header_file_.path()))),
-                         NamespaceStart(),
-                         NamespaceEnd()));
+  rule->WriteCommand(strings::JoinWith(
+      " ",
+      EmbedTool(input()),
+      header_file_.path(),
+      source_file_.path(),
+      incbin_ ? asm_file_.path() : "-",
+      strings::UpperString(
+          RemoveNonAlpha(StripSpecialDirs(header_file_.path()))),
+      NamespaceStart(),
+      NamespaceEnd(),
+      "repobuild_" + RemoveNonAlpha(target().make_path()) + "_",
+      strings::JoinAll(inputs, " ")));
   out->FinishRule(rule);
 
   // cc file depends on header file. Originally this was part of StartRule
   // above, but it tickled a bug in make that executed the script twice
   // (and overwrote the file with bad data).
   out->WriteRule(source_file_.path(), header_file_.path());
+  if (incbin_) {
+    out->WriteRule(asm_file_.path(), header_file_.path());
+  }
 
   ResourceFileSet files;
-  files.Add(source_file_);
-  files.Add(header_file_);
+  LocalDependencyFiles(NO_LANG, &files);
   WriteBaseUserTarget(files, out);
 }
 
@@ -134,11 +289,21 @@ void CCEmbedDataNodeRaw::LocalDependencyFiles(LanguageType lang,
                                               ResourceFileSet* files) const {
   files->Add(header_file_);
   files->Add(source_file_);
+  if (incbin_) {
+    // The assembler reads the data files when compiling asm_file_.
+    files->Add(asm_file_);
+    for (const Resource& source : sources_) {
+      files->Add(source);
+    }
+  }
 }
 
 void CCEmbedDataNodeRaw::GetOutputs(ResourceFileSet* sources,
                                     ResourceFileSet* headers) const {
   sources->Add(source_file_);
+  if (incbin_) {
+    sources->Add(asm_file_);
+  }
   headers->Add(header_file_);
 }
 
@@ -166,54 +331,13 @@ void CCEmbedDataNode::Parse(BuildFile* file, const BuildFileNode& input) {
 
 // static
 void CCEmbedDataNode::WriteMakeHead(const Input& input, Makefile* out) {
-  const char kShellScript[] =
-      "#!/bin/bash\n"
-      "HEADER=\"$1\"\n"
-      "CPP=\"$2\"\n"
-      "GUARD=\"$3\"\n"
-      "NAMESPACE_START=\"$4\"\n"
-      "NAMESPACE_END=\"$5\"\n"
-      // Header - start
-      "echo \"#ifndef $GUARD\" > $HEADER\n"
-      "echo \"#define $GUARD\" >> $HEADER\n"
-      "echo \"#include <cstring>  // size_t\" >> $HEADER\n"
-      "echo \"$NAMESPACE_START\" >> $HEADER\n"
-      // Cpp - start
-      "echo \"#include \\\"$(basename $HEADER)\\\"\" > $CPP\n"
-      "echo \"$NAMESPACE_START\" >> $CPP\n"
-
-      // Per-variable
-      "while read SOURCE VARIABLE; do"
-      //   Header
-      "  echo \"// Auto generated from $SOURCE\" >> $HEADER\n"
-      "  echo \"extern const char* \"$VARIABLE\"_data();\" >> $HEADER\n"
-      "  echo \"extern size_t \"$VARIABLE\"_size();\" >> $HEADER\n"
-      "  echo \"\" >> $HEADER\n"
-      //   Cpp
-      "  echo \"const char* \"$VARIABLE\"_data() {\" >> $CPP\n"
-      "  printf \"  return \\\"\" >> $CPP\n"
-      "  cat $SOURCE "
-      "    | perl -pe 's|\\\\|\\\\\\\\|g' "
-      "    | perl -pe 's|\\\"|\\\\\"|g' "
-      "    | perl -pe 's|\\n|\\\\n|g' >> $CPP\n"
-      "  echo \"\\\";\" >> $CPP\n"
-      "  echo \"}\" >> $CPP\n"
-      "  echo \"size_t \"$VARIABLE\"_size()\" { >> $CPP\n"
-      "  printf \"  return \" >> $CPP\n"
-      "  printf $(cat $SOURCE | wc -c) >> $CPP\n"
-      "  echo \";\" >> $CPP\n"
-      "  echo \"}\" >> $CPP\n"
-      "done\n"
-
-      // Header - end
-      "echo \"$NAMESPACE_END\" >> $HEADER\n"
-      "echo \"#endif  // $GUARD\" >> $HEADER\n"
-
-      // Cpp - end
-      "echo \"$NAMESPACE_END\" >> $CPP\n";
-  out->GenerateExecFile("CCEmbed",
-                        EmbedScript(input),
-                        kShellScript);
+  out->GenerateExecFile("CCEmbed", EmbedSource(input), kEmbedSource);
+  Makefile::Rule* rule =
+      out->StartRawRule(EmbedTool(input), EmbedSource(input));
+  rule->WriteCommand("mkdir -p " + strings::PathDirname(EmbedTool(input)));
+  rule->WriteCommand("$(CC) -O2 -o " + EmbedTool(input) + " " +
+                     EmbedSource(input));
+  out->FinishRule(rule);
 }
 
 }  // namespace repobuild
@@ -1,6 +1,8 @@
 // Copyright 2013
 // Author: Christopher Van Arsdale
 
+#include <algorithm>
+#include <map>
 #include <string>
 #include <set>
 #include <iterator>
@@ -13,6 +15,7 @@
 #include "repobuild/nodes/util.h"
 #include "repobuild/reader/buildfile.h"
 
+using std::map;
 using std::vector;
 using std::string;
 using std::set;
@@ -26,9 +29,14 @@ const char kCxxCompileArgs[] = "cxx_compile_args";
 const char kCHeaderArgs[] = "c_header_compile_args";
 const char kCxxHeaderArgs[] = "cxx_header_compile_args";
 const char kCGcc[] = "CC_GCC";
-const char kCxxGcc[] = "CXX_GCC";
+
+// Lines that make a c++ source a module unit or an importer (grep -E).
+const char kModuleDeclaration[] =
+    "^[[:space:]]*(export[[:space:]]+)?(import|module)([[:space:]]|;|<|\")";
 }
 
+const char CCLibraryNode::kCxxGcc[] = "CXX_GCC";
+
 void CCLibraryNode::Parse(BuildFile* file, const BuildFileNode& input) {
   Node::Parse(file, input);
 
@@ -50,6 +58,11 @@ void CCLibraryNode::Parse(BuildFile* file, const BuildFileNode& input) {
     sources_.push_back(it);
   }
 
+  // cc_module_interfaces: { "module.name": "file.cppm" }, cc_header_units
+  current_reader()->ParseKeyValueFiles("cc_module_interfaces",
+                                       &module_interfaces_);
+  current_reader()->ParseRepeatedFiles("cc_header_units", &header_units_);
+
   // alwayslink
   bool alwayslink = false;
   if (current_reader()->ParseBoolField("alwayslink", &alwayslink) &&
@@ -57,11 +70,39 @@ void CCLibraryNode::Parse(BuildFile* file, const BuildFileNode& input) {
     for (Resource& r : objects_) {
       r.add_tag("alwayslink");
     }
+    for (auto& it : module_interfaces_) {
+      it.second.add_tag("alwayslink");
+    }
     for (Resource& r : sources_) {
       r.add_tag("alwayslink");
     }
   }
 
+  // cc_pch
+  vector<Resource> pch;
+  current_reader()->ParseSingleFile("cc_pch", &pch);
+  if (pch.size() > 1) {
+    LOG(FATAL) << "cc_pch must match exactly 1 file in "
+               << target().full_path()
+               << ". Found " << pch.size() << " files.";
+  } else if (pch.size() == 1) {
+    pch_ = pch[0];
+  }
+
+  // thin_archive
+  thin_archive_ = Node::input().cc_thin_archives();
+  current_reader()->ParseBoolField("thin_archive", &thin_archive_);
+  dev_shared_ = Node::input().cc_dev_shared_libraries();
+
+  // unity_size, unity_exclude
+  unity_size_ = Node::input().cc_unity_size();
+  current_reader()->ParseIntField("unity_size", &unity_size_);
+  vector<Resource> unity_exclude;
+  current_reader()->ParseRepeatedFiles("unity_exclude", &unity_exclude);
+  for (const Resource& r : unity_exclude) {
+    unity_exclude_.insert(r.path());
+  }
+
   // cc_include_dirs
   vector<Resource> cc_include_dirs;
   current_reader()->ParseRepeatedFiles("cc_include_dirs",
@@ -166,47 +207,282 @@ void CCLibraryNode::LocalWriteMake(Makefile* out) const {
 
 void CCLibraryNode::LocalWriteMakeInternal(bool should_write_target,
                                            Makefile* out) const {
+  ResourceFileSet targets;
+  WriteCompiles(ObjectVariant(), &targets, out);
+
+  // Shared library or thin archive of our (non ephemeral) objects.
+  ResourceFileSet archived;
+  for (const Resource& obj : targets) {
+    if (!obj.has_tag("ephemeral")) {
+      archived.Add(obj);
+    }
+  }
+  if (dev_shared_ && !archived.files().empty()) {
+    Resource so = DevSharedLibrary();
+    string obj_list = WriteLinkInputs(
+        archived, false, Resource::FromRootPath(so.path() + ".rsp"), out);
+    set<string> flags;
+    LinkFlags(CPP, &flags);
+    Makefile::Rule* rule =
+        out->StartRule(so.path(), strings::JoinAll(archived.files(), " "));
+    if (input().cc_link_response_files()) {
+      rule->AddDependency(so.path() + ".rsp");
+    }
+    rule->WriteUserEcho("Linking", so.path());
+    rule->WriteCommand("mkdir -p " + so.dirname());
+    rule->WriteCommand(strings::JoinWith(
+        " ",
+        "$(LINK.cc) -shared -Wl,-soname," + so.basename(),
+        obj_list, "-o", so.path(),
+        strings::JoinAll(flags, " ")));
+    out->FinishRule(rule);
+    targets.Add(so);
+  } else if (thin_archive_ && !archived.files().empty()) {
+    Resource archive = ThinArchive();
+    Makefile::Rule* rule =
+        out->StartRule(archive.path(),
+                       strings::JoinAll(archived.files(), " "));
+    rule->WriteUserEcho("Archiving", archive.path());
+    rule->WriteCommand("rm -f " + archive.path());
+    rule->WriteCommand("$(AR) rcsT " + archive.path() + " " +
+                       strings::JoinAll(archived.files(), " "));
+    out->FinishRule(rule);
+    targets.Add(archive);
+  }
+
+  // Now write user target (so users can type "make path/to/exec|lib").
+  if (should_write_target) {
+    WriteBaseUserTarget(targets, out);
+  }
+}
+
+void CCLibraryNode::ArchiveObjects(const ResourceFileSet& compiled,
+                                   ResourceFileSet* objects) const {
+  if (!thin_archive_ && !dev_shared_) {
+    objects->AddRange(compiled);
+    return;
+  }
+  bool archived = false;
+  for (const Resource& obj : compiled) {
+    if (obj.has_tag("ephemeral")) {
+      objects->Add(obj);
+    } else if (!archived) {
+      objects->Add(dev_shared_ ? DevSharedLibrary() : ThinArchive());
+      archived = true;
+    }
+  }
+}
+
+Resource CCLibraryNode::DevSharedLibrary() const {
+  // One directory (and rpath) for all of them, so the names are unique.
+  Resource r = Resource::FromLocalPath(
+      strings::JoinPath(input().object_dir(), "dev_libs"),
+      "lib" + strings::ReplaceAll(target().make_path(), "/", "_") + ".so");
+  r.add_tag("dev_shared");
+  return r;
+}
+
+string CCLibraryNode::WriteLinkInputs(const ResourceFileSet& objects,
+                                      bool whole_archives,
+                                      const Resource& response_file,
+                                      Makefile* out) const {
+  // HACK(cvanarsdale):
+  // Sadly order matters to the (gcc) linker. It looks in later object
+  // files to find unresolved symbols. We collect the dependencies
+  // bottom up, so we push resources onto the front of the list so
+  // unencumbered resources end up in the back of the list.
+  vector<string> inputs;
+  vector<Resource> copy = objects.files();
+  std::reverse(copy.begin(), copy.end());
+  for (const Resource& r : copy) {
+    bool whole = (r.has_tag("alwayslink") ||
+                  (whole_archives && strings::HasSuffix(r.path(), ".a")));
+    if (whole) {
+      inputs.push_back("$(LD_FORCE_LINK_START)");
+    }
+    inputs.push_back(r.path());
+    if (whole) {
+      inputs.push_back("$(LD_FORCE_LINK_END)");
+    }
+  }
+  if (!input().cc_link_response_files()) {
+    return strings::JoinAll(inputs, " ");
+  }
+  out->GenerateFileIfChanged(response_file.path(), inputs);
+  return "@" + response_file.path();
+}
+
+Resource CCLibraryNode::ThinArchive() const {
+  Resource r = Resource::FromLocalPath(input().object_dir(),
+                                       target().make_path() + ".a");
+  for (const Resource& source : sources_) {
+    if (source.has_tag("alwayslink")) {
+      r.add_tag("alwayslink");  // whole archive.
+    }
+  }
+  return r;
+}
+
+void CCLibraryNode::LocalWriteMakeVariant(LanguageType lang,
+                                          const ObjectVariant& variant,
+                                          ResourceFileSet* objects,
+                                          Makefile* out) const {
+  ResourceFileSet compiled;
+  WriteCompiles(variant, &compiled, out);
+  if (variant.ephemeral_only) {
+    ArchiveObjects(compiled, objects);  // the rest is unchanged.
+  } else {
+    objects->AddRange(compiled);
+  }
+  for (const Resource& obj : objects_) {
+    objects->Add(obj);
+  }
+}
+
+void CCLibraryNode::WriteCompiles(const ObjectVariant& variant,
+                                  ResourceFileSet* objects,
+                                  Makefile* out) const {
+  // The main build also writes the rules for the shared (pch, unity)
+  // inputs of our compiles.
+  bool main_build = variant.object_dir.empty();
+
   // Figure out the set of input files.
   ResourceFileSet input_files;
   InputDependencyFiles(CPP, &input_files);  // any object files/headers/etc.
-  CCLibraryNode::LocalDependencyFiles(CPP, &input_files);  // our headers
+  if (UsesCxxModules()) {
+    input_files.Add(ModuleMap());
+    input_files.Add(Resource::FromRootPath(ModuleMap().path() + ".clang"));
+    if (main_build) {
+      ResourceFileSet module_inputs = input_files;
+      if (HasVariable(kHeaderVariable)) {
+        module_inputs.Add(Resource::FromRaw(
+            GetVariable(kHeaderVariable).ref_name()));
+      }
+      WriteModules(module_inputs, out);
+    }
+  }
+  CCLibraryNode::LocalDependencyFiles(CPP, &input_files);  // headers, BMIs.
 
-  // Now write phases, one per .cc
-  for (int i = 0; i < sources_.size(); ++i) {
-    // Output object.
-    WriteCompile(sources_[i], input_files, out);
+  // Precompiled header, built with the same flags as our c++ sources.
+  if (main_build && !pch_.path().empty()) {
+    WritePch(input_files, out);
   }
 
-  // Now write user target (so users can type "make path/to/exec|lib").
-  if (should_write_target) {
-    ResourceFileSet targets;
-    for (const Resource& source : sources_) {
-      targets.Add(ObjForSource(source));
+  // Module interface units are only compiled by the main build: gcc
+  // writes the BMI as it compiles, so a variant would overwrite it.
+  for (const auto& it : module_interfaces_) {
+    objects->Add(ObjForSource(it.second, ObjectVariant()));
+  }
+
+  // Now write phases, one per .cc (or per unity batch).
+  vector<Resource> singles;
+  vector<vector<Resource> > batches;
+  UnitySources(&singles, &batches);
+  for (const Resource& source : singles) {
+    if (!variant.ephemeral_only || source.has_tag("ephemeral")) {
+      WriteCompile(source, input_files, variant, out);
     }
-    WriteBaseUserTarget(targets, out);
+    objects->Add(ObjForSource(source, variant));
+  }
+  for (int i = 0; i < batches.size(); ++i) {
+    Resource unity = UnitySource(i, batches[i]);
+    if (variant.ephemeral_only) {
+      objects->Add(ObjForSource(unity, variant));
+      continue;
+    } else if (main_build) {
+      WriteUnitySource(unity, batches[i], out);
+    }
+    ResourceFileSet unity_inputs = input_files;
+    unity_inputs.AddRange(batches[i]);
+    WriteCompile(unity, unity_inputs, variant, out);
+    objects->Add(ObjForSource(unity, variant));
   }
 }
 
+void CCLibraryNode::UnitySources(vector<Resource>* singles,
+                                 vector<vector<Resource> >* batches) const {
+  for (const Resource& source : sources_) {
+    bool cpp = (strings::HasSuffix(source.basename(), ".cc") ||
+                strings::HasSuffix(source.basename(), ".cpp"));
+    // Module flags are per source, see WriteCompile.
+    if (unity_size_ <= 1 || !cpp || source.has_tag("ephemeral") ||
+        UsesCxxModules() ||
+        unity_exclude_.find(source.path()) != unity_exclude_.end()) {
+      singles->push_back(source);
+      continue;
+    }
+    if (batches->empty() || batches->back().size() >= unity_size_) {
+      batches->push_back(vector<Resource>());
+    }
+    batches->back().push_back(source);
+  }
+
+  // A batch of one is just the source itself.
+  if (!batches->empty() && batches->back().size() == 1) {
+    singles->push_back(batches->back()[0]);
+    batches->pop_back();
+  }
+}
+
+Resource CCLibraryNode::UnitySource(int index,
+                                    const vector<Resource>& batch) const {
+  Resource r = Resource::FromLocalPath(
+      input().genfile_dir(),
+      strings::Join(target().make_path(), ".unity_", index, ".cc"));
+  r.CopyTags(batch[0]);  // e.g. alwayslink.
+  return r;
+}
+
+void CCLibraryNode::WriteUnitySource(const Resource& unity,
+                                     const vector<Resource>& batch,
+                                     Makefile* out) const {
+  // Includes are relative to the unity file, so they do not depend on
+  // include directories.
+  vector<string> lines;
+  lines.push_back("// Unity source for " + target().full_path());
+  for (const Resource& source : batch) {
+    lines.push_back("#include \"" +
+                    strings::GetRelativePath(unity.dirname(), source.path()) +
+                    "\"");
+  }
+  out->GenerateFileIfChanged(unity.path(), lines);
+}
+
 void CCLibraryNode::WriteCompile(const Resource& source,
                                  const ResourceFileSet& input_files,
+                                 const ObjectVariant& variant,
                                  Makefile* out) const {
-  Resource obj = ObjForSource(source);
-  bool ephemeral_output = source.has_tag("ephemeral");
-  string ephemeral_dot_o;
-
-  if (ephemeral_output) {
-    // When a user runs a parallel make ("make -j8"), two cc_binaries
-    // that depend on the same cc_library containing ephemeral sources
-    // may each call make recursively to compile the same source file.
-    // To avoid corruption by simultaneous compilation to the same .o
-    // file, we use distinct temporary file names, then "mv" the .o
-    // file to the correct place atomically.  It remains a race as to
-    // which instance of the .o gets used: it could be either or both.
-    ephemeral_dot_o = "ephemeral" + obj.path();
-    out->append("\n" + ephemeral_dot_o +
-		" := $(shell mkdir -p " + obj.dirname() + "; "
-		"mktemp --tmpdir=" + obj.dirname() + ")\n");
-    ephemeral_dot_o = "$(" + ephemeral_dot_o + ")";
+  Resource obj = ObjForSource(source, variant);
+
+  // Ephemeral sources are compiled once per consumer (each with its own
+  // object dir), and recompiled whenever the consumer's other objects
+  // change. Only our own copy (for "make path/to/lib") is always rebuilt.
+  bool ephemeral = source.has_tag("ephemeral");
+  string ephemeral_deps = ephemeral ? variant.ephemeral_dependencies : "";
+
+  // Compile command (.e.g $(COMPILE.c) or $(COMPILE.cc)).
+  bool cpp = (strings::HasSuffix(source.basename(), ".cc") ||
+              strings::HasSuffix(source.basename(), ".cpp"));
+  string compile = DefaultCompileFlags(cpp);
+
+  // Precompiled header: gcc and clang both pick up <header>.gch next to
+  // the -include'd symlink (and fall back to the header itself). Variants
+  // use different flags, so the pch would not apply.
+  string pch_include, pch_deps;
+  if (cpp && !pch_.path().empty() && variant.object_dir.empty()) {
+    pch_include = "-include " + PchSymlink().path();
+    pch_deps = PchSymlink().path() + " " + PchOutput().path();
+  }
+
+  // Module flags (-std=c++20, module maps) only for sources that import a
+  // module, decided when compiling so the Makefile does not depend on
+  // source contents. The pch is built without them, so those skip it.
+  string module_flags;
+  if (cpp && UsesCxxModules()) {
+    module_flags = "$$(grep -Eq '" + string(kModuleDeclaration) + "' " +
+        source.path() + " && echo '" + ModuleFlags() + "' || echo '" +
+        pch_include + "')";
+    pch_include.clear();
   }
 
   // Rule=> obj: <input header files> source.cc
@@ -215,16 +491,236 @@ void CCLibraryNode::WriteCompile(const Resource& source,
                      strings::JoinWith(
                          " ",
                          strings::JoinAll(input_files.files(), " "),
+                         pch_deps,
+                         variant.dependencies,
+                         ephemeral_deps,
                          source.path()));
   
   // Mkdir command.
   rule->WriteCommand("mkdir -p " + obj.dirname());
 
-  // Compile command (.e.g $(COMPILE.c) or $(COMPILE.cc)).
-  bool cpp = (strings::HasSuffix(source.basename(), ".cc") ||
-              strings::HasSuffix(source.basename(), ".cpp"));
-  string compile = DefaultCompileFlags(cpp);
+  // Actual make command.
+  rule->WriteUserEcho("Compiling",
+                      source.path() + " (" + (cpp ? "c++" : "c") + ")");
+  rule->WriteCommand(strings::JoinWith(
+      " ",
+      compile,
+      CompileArgs(cpp),
+      module_flags,
+      variant.compile_flags,
+      pch_include,
+      source.path(),
+      "-o " + obj.path()));
+  out->FinishRule(rule);
+
+  if (ephemeral && variant.object_dir.empty()) {
+    // Tell make to ignore any existing object file; i.e., force recompile.
+    out->append("\n.PHONY: ");
+    out->append(obj.path());
+    out->append("\n\n");
+  }
+}
+
+void CCLibraryNode::WritePch(const ResourceFileSet& input_files,
+                             Makefile* out) const {
+  Resource symlink = PchSymlink(), output = PchOutput();
+  out->WriteRootSymlink(symlink.path(), pch_.path());
+
+  Makefile::Rule* rule =
+      out->StartRule(output.path(),
+                     strings::JoinWith(
+                         " ",
+                         strings::JoinAll(input_files.files(), " "),
+                         pch_.path()));
+  rule->WriteCommand("mkdir -p " + output.dirname());
+  rule->WriteUserEcho("Compiling", pch_.path() + " (pch)");
+  rule->WriteCommand(strings::JoinWith(
+      " ",
+      DefaultCompileFlags(true),
+      CompileArgs(true),
+      "-x c++-header",
+      pch_.path(),
+      "-o " + output.path()));
+  out->FinishRule(rule);
+}
+
+Resource CCLibraryNode::PchSymlink() const {
+  // Per library, since the pch is only valid for our exact flags.
+  return Resource::FromLocalPath(
+      input().object_dir(),
+      strings::JoinPath(target().make_path() + ".pch", pch_.basename()));
+}
+
+Resource CCLibraryNode::PchOutput() const {
+  return Resource::FromRootPath(PchSymlink().path() + ".gch");
+}
+
+bool CCLibraryNode::UsesCxxModules() const {
+  // Asked for every compile and walks all of our dependencies.
+  if (!cxx_modules_known_) {
+    map<string, Resource> modules;
+    CxxModules(CPP, &modules);
+    uses_cxx_modules_ = !modules.empty();
+    cxx_modules_known_ = true;
+  }
+  return uses_cxx_modules_;
+}
+
+string CCLibraryNode::ModuleFlags() const {
+  return "$(call CXX_MODULE_FLAGS," + ModuleMap().path() + ")";
+}
+
+Resource CCLibraryNode::ModuleBmi(const string& name) const {
+  // NB: partitions ("a:b") would break make rules.
+  return Resource::FromLocalPath(
+      input().object_dir(),
+      strings::JoinPath(target().make_path() + ".modules",
+                        strings::ReplaceAll(name, ":", "-") + ".bmi"));
+}
+
+Resource CCLibraryNode::HeaderUnitBmi(const Resource& header) const {
+  Resource r = Resource::FromLocalPath(
+      input().object_dir(),
+      strings::JoinPath(target().make_path() + ".modules",
+                        header.path() + ".bmi"));
+  r.add_tag("header_unit");
+  return r;
+}
+
+Resource CCLibraryNode::ModuleMap() const {
+  return Resource::FromLocalPath(input().genfile_dir(),
+                                 target().make_path() + ".modmap");
+}
+
+void CCLibraryNode::WriteModules(const ResourceFileSet& input_files,
+                                 Makefile* out) const {
+  // Module maps, naming every BMI we can import: a gcc module mapper file
+  // and a clang response file.
+  map<string, Resource> modules;
+  CxxModules(CPP, &modules);
+  vector<string> gcc_map, clang_map;
+  for (const auto& it : modules) {
+    const string& bmi = it.second.path();
+    gcc_map.push_back(it.first + " $(CURDIR)/" + bmi);
+    if (it.second.has_tag("header_unit")) {
+      // gcc names user header units by the path it found them at.
+      gcc_map.push_back("./" + it.first + " $(CURDIR)/" + bmi);
+      clang_map.push_back("-fmodule-file=" + bmi);
+    } else {
+      clang_map.push_back("-fmodule-file=" + it.first + "=" + bmi);
+    }
+  }
+  out->GenerateFileIfChanged(ModuleMap().path(), gcc_map);
+  out->GenerateFileIfChanged(ModuleMap().path() + ".clang", clang_map);
+
+  // Header units.
+  string compile = strings::JoinWith(" ",
+                                     DefaultCompileFlags(true),
+                                     CompileArgs(true),
+                                     ModuleFlags());
+  string dependencies = strings::JoinAll(input_files.files(), " ");
+  vector<string> header_bmis;
+  for (const Resource& header : header_units_) {
+    Resource bmi = HeaderUnitBmi(header);
+    header_bmis.push_back(bmi.path());
+    Makefile::Rule* rule =
+        out->StartRule(bmi.path(),
+                       strings::JoinWith(" ", dependencies, header.path()));
+    rule->WriteCommand("mkdir -p " + bmi.dirname());
+    rule->WriteUserEcho("Compiling", header.path() + " (header unit)");
+    rule->WriteCommand(
+        "if [ \"$(" + string(kCxxGcc) + ")\" = 1 ]; then " +
+        strings::JoinWith(" ", compile, "-fmodule-header -x c++-header",
+                          header.path()) +
+        "; else " +
+        strings::JoinWith(" ", compile,
+                          "-fmodule-header --precompile -x c++-header",
+                          header.path(), "-o", bmi.path()) +
+        "; fi");
+    out->FinishRule(rule);
+  }
+
+  // Interface units.
+  for (const auto& it : module_interfaces_) {
+    WriteModuleInterface(
+        it.first, it.second,
+        strings::JoinWith(" ", dependencies,
+                          strings::JoinAll(header_bmis, " ")),
+        out);
+  }
+}
+
+void CCLibraryNode::WriteModuleInterface(const string& name,
+                                         const Resource& source,
+                                         const string& dependencies,
+                                         Makefile* out) const {
+  Resource bmi = ModuleBmi(name);
+  Resource obj = ObjForSource(source, ObjectVariant());
+  string compile = strings::JoinWith(" ",
+                                     DefaultCompileFlags(true),
+                                     CompileArgs(true),
+                                     ModuleFlags());
+
+  // Dependency scan: "import x;" of another of our interfaces (typically
+  // a partition, "import :part;") must be built first. Modules of our
+  // dependencies are already ordered through LocalDependencyFiles().
+  string own;
+  for (const auto& it : module_interfaces_) {
+    own += " " + it.first;
+  }
+  string primary = name.substr(0, name.find(':'));
+  string scan = bmi.path() + ".d";
+  Makefile::Rule* rule = out->StartRule(scan, source.path());
+  rule->WriteCommand("mkdir -p " + bmi.dirname());
+  rule->WriteCommand(
+      "for m in $$(sed -n 's/^[[:space:]]*\\(export[[:space:]]*\\)\\{0,1\\}"
+      "import[[:space:]]*\\([A-Za-z0-9_.:]*\\)[[:space:]]*;.*/\\2/p' " +
+      source.path() + " | sed 's/^:/" + primary + ":/'); do "
+      "case \"" + own + " \" in *\" $$m \"*) "
+      "echo \"" + bmi.path() + " " + obj.path() + ": " + bmi.dirname() +
+      "/$$(echo $$m | tr : -).bmi\";; esac; done > " + scan + ".tmp && "
+      "mv -f " + scan + ".tmp " + scan);
+  out->FinishRule(rule);
+  out->append("-include " + scan + "\n");
+
+  // gcc writes the BMI (through the module mapper) as a side effect of
+  // compiling the object, clang precompiles the BMI and compiles that.
+  // gcc has no output flag for the BMI, so check the mapper put it where
+  // we expect (it does not if the source exports another module name).
+  string check_bmi = "test -f " + bmi.path() + " || { echo \"" +
+      source.path() + ": no BMI for module " + name + " at " + bmi.path() +
+      ", does it export module " + name + "?\" >&2; exit 1; }";
+  out->append("ifeq ($(" + string(kCxxGcc) + "),1)\n");
+  rule = out->StartRule(obj.path(),
+                        strings::JoinWith(" ", dependencies, source.path()));
+  rule->WriteCommand("mkdir -p " + obj.dirname());
+  rule->WriteCommand("rm -f " + bmi.path());
+  rule->WriteUserEcho("Compiling", source.path() + " (module " + name + ")");
+  rule->WriteCommand(strings::JoinWith(" ", compile, "-x c++", source.path(),
+                                       "-o", obj.path()));
+  rule->WriteCommand(check_bmi);
+  out->FinishRule(rule);
+  rule = out->StartRule(bmi.path(), obj.path());
+  rule->WriteCommand(check_bmi + " && touch " + bmi.path());
+  out->FinishRule(rule);
+  out->append("else\n");
+  rule = out->StartRule(bmi.path(),
+                        strings::JoinWith(" ", dependencies, source.path()));
+  rule->WriteCommand("mkdir -p " + bmi.dirname());
+  rule->WriteUserEcho("Compiling", source.path() + " (module " + name + ")");
+  rule->WriteCommand(strings::JoinWith(" ", compile,
+                                       "--precompile -x c++-module",
+                                       source.path(), "-o", bmi.path()));
+  out->FinishRule(rule);
+  rule = out->StartRule(obj.path(), bmi.path());
+  rule->WriteCommand("mkdir -p " + obj.dirname());
+  rule->WriteCommand(strings::JoinWith(" ", compile, bmi.path(),
+                                       "-o", obj.path()));
+  out->FinishRule(rule);
+  out->append("endif\n");
+}
 
+string CCLibraryNode::CompileArgs(bool cpp) const {
   // Include directories.
   string include_dirs;
   {
@@ -258,29 +754,7 @@ void CCLibraryNode::WriteCompile(const Resource& source,
         GetVariable(cpp ? kCxxCompileArgs : kCCompileArgs).ref_name());
   }
 
-  // Actual make command.
-  rule->WriteUserEcho("Compiling",
-                      source.path() + " (" + (cpp ? "c++" : "c") + ")");
-  rule->WriteCommand(strings::JoinWith(
-      " ",
-      compile,
-      include_dirs,
-      output_compile_args,
-      source.path(),
-      "-o " + (ephemeral_output ? ephemeral_dot_o : obj.path())));
-
-  if (ephemeral_output) {
-    rule->WriteCommand("mv " + ephemeral_dot_o + " " + obj.path());
-  }
-
-  out->FinishRule(rule);
-
-  if (ephemeral_output) {
-    // Tell make to ignore any existing object file; i.e., force recompile.
-    out->append("\n.PHONY: ");
-    out->append(obj.path());
-    out->append("\n\n");
-  }
+  return strings::JoinWith(" ", include_dirs, output_compile_args);
 }
 
 void CCLibraryNode::LocalDependencyFiles(LanguageType lang,
@@ -289,13 +763,30 @@ void CCLibraryNode::LocalDependencyFiles(LanguageType lang,
     files->Add(Resource::FromRaw(
         GetVariable(kHeaderVariable).ref_name()));
   }
+  map<string, Resource> modules;
+  CCLibraryNode::LocalCxxModules(CPP, &modules);
+  for (const auto& it : modules) {
+    files->Add(it.second);  // BMIs, built before anything importing them.
+  }
 }
 
 void CCLibraryNode::LocalObjectFiles(LanguageType lang,
                                      ResourceFileSet* files) const {
-  for (const Resource& src : sources_) {
-    files->Add(ObjForSource(src));
+  ObjectVariant main_build;
+  vector<Resource> singles;
+  vector<vector<Resource> > batches;
+  UnitySources(&singles, &batches);
+  ResourceFileSet compiled;
+  for (const auto& it : module_interfaces_) {
+    compiled.Add(ObjForSource(it.second, main_build));
+  }
+  for (const Resource& src : singles) {
+    compiled.Add(ObjForSource(src, main_build));
   }
+  for (int i = 0; i < batches.size(); ++i) {
+    compiled.Add(ObjForSource(UnitySource(i, batches[i]), main_build));
+  }
+  ArchiveObjects(compiled, files);
   for (const Resource& obj : objects_) {
     files->Add(obj);
   }
@@ -315,6 +806,16 @@ void CCLibraryNode::LocalIncludeDirs(LanguageType lang,
   dirs->insert(cc_include_dirs_.begin(), cc_include_dirs_.end());
 }
 
+void CCLibraryNode::LocalCxxModules(LanguageType lang,
+                                    map<string, Resource>* modules) const {
+  for (const auto& it : module_interfaces_) {
+    (*modules)[it.first] = ModuleBmi(it.first);
+  }
+  for (const Resource& header : header_units_) {
+    (*modules)[header.path()] = HeaderUnitBmi(header);
+  }
+}
+
 void CCLibraryNode::LocalCompileFlags(LanguageType lang,
                                       set<string>* flags) const {
   if (lang == CPP) {
@@ -427,6 +928,12 @@ void CCLibraryNode::WriteMakeHead(const Input& input, Makefile* out) {
   out->append("\t" + WriteLdflag(input, true));
   out->append("\t" + WriteCxxflag(input, true, false));
   out->append("\t" + WriteCxxflag(input, true, true));
+  out->append("\tPGO_GEN_FLAGS = -fprofile-generate=$(1) "
+              "-fprofile-update=atomic\n");
+  out->append("\tPGO_USE_FLAGS = -fprofile-use=$(1) -fprofile-correction "
+              "-Wno-missing-profile -Wno-coverage-mismatch\n");
+  out->append("\tCXX_MODULE_FLAGS = -std=c++20 -fmodules-ts "
+              "-fmodule-mapper=$(1)\n");
   out->append("else\n");
   // The gold linker used by clang also supports whole-archive
   out->append("\tLD_FORCE_LINK_START := -Wl,--whole-archive\n");
@@ -434,12 +941,23 @@ void CCLibraryNode::WriteMakeHead(const Input& input, Makefile* out) {
   out->append("\t" + WriteLdflag(input, false));
   out->append("\t" + WriteCxxflag(input, false, false));
   out->append("\t" + WriteCxxflag(input, false, true));
-  out->append("endif\n\n");
+  out->append("\tPGO_GEN_FLAGS = -fprofile-instr-generate=$(1)/%p.profraw\n");
+  out->append("\tPGO_USE_FLAGS = -fprofile-instr-use=$(1)/merged.profdata "
+              "-Wno-profile-instr-out-of-date -Wno-profile-instr-unprofiled "
+              "-Wno-profile-instr-missing\n");
+  out->append("\tCXX_MODULE_FLAGS = -std=c++20 @$(1).clang\n");
+  out->append("endif\n");
+  out->append("LLVM_PROFDATA ?= llvm-profdata\n");
+  out->append("DWP ?= dwp\n\n");
 }
 
-Resource CCLibraryNode::ObjForSource(const Resource& source) const {
-  Resource r = Resource::FromLocalPath(input().object_dir(),
-                                       StripSpecialDirs(source.path()) + ".o");
+Resource CCLibraryNode::ObjForSource(const Resource& source,
+                                     const ObjectVariant& variant) const {
+  bool main_build = (variant.object_dir.empty() ||
+                     (variant.ephemeral_only && !source.has_tag("ephemeral")));
+  Resource r = Resource::FromLocalPath(
+      main_build ? input().object_dir() : variant.object_dir,
+      StripSpecialDirs(source.path()) + ".o");
   r.CopyTags(source);
   return r;
 }
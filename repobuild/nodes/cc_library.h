@@ -4,6 +4,7 @@
 #ifndef _REPOBUILD_NODES_CC_LIBRARY_H__
 #define _REPOBUILD_NODES_CC_LIBRARY_H__
 
+#include <map>
 #include <string>
 #include <set>
 #include <vector>
@@ -16,7 +17,12 @@ class CCLibraryNode : public Node {
   CCLibraryNode(const TargetInfo& t,
                 const Input& i,
                 DistSource* source)
-      : Node(t, i, source) {
+      : Node(t, i, source),
+        unity_size_(0),
+        thin_archive_(false),
+        dev_shared_(false),
+        cxx_modules_known_(false),
+        uses_cxx_modules_(false) {
   }
   virtual ~CCLibraryNode() {}
   virtual void Parse(BuildFile* file, const BuildFileNode& input);
@@ -25,12 +31,18 @@ class CCLibraryNode : public Node {
                                     ResourceFileSet* files) const;
   virtual void LocalObjectFiles(LanguageType lang,
                                 ResourceFileSet* files) const;
+  virtual void LocalWriteMakeVariant(LanguageType lang,
+                                     const ObjectVariant& variant,
+                                     ResourceFileSet* objects,
+                                     Makefile* out) const;
   virtual void LocalLinkFlags(LanguageType lang,
                               std::set<std::string>* flags) const;
   virtual void LocalCompileFlags(LanguageType lang,
                                  std::set<std::string>* flags) const;
   virtual void LocalIncludeDirs(LanguageType lang,
                                 std::set<std::string>* flags) const;
+  virtual void LocalCxxModules(LanguageType lang,
+                               std::map<std::string, Resource>* modules) const;
 
   // Alterative to Parse()
   void Set(const std::vector<Resource>& sources,
@@ -49,11 +61,67 @@ class CCLibraryNode : public Node {
  protected:
   void Init();
   std::string DefaultCompileFlags(bool cpp_mode) const;
+  std::string CompileArgs(bool cpp_mode) const;  // includes + flags.
+  void WriteCompiles(const ObjectVariant& variant,
+                     ResourceFileSet* objects,
+                     Makefile* out) const;
   void WriteCompile(const Resource& source,
                     const ResourceFileSet& input_files,
+                    const ObjectVariant& variant,
                     Makefile* out) const;
   void LocalWriteMakeInternal(bool should_write_target, Makefile* out) const;
-  Resource ObjForSource(const Resource& source) const;
+  Resource ObjForSource(const Resource& source,
+                        const ObjectVariant& variant) const;
+
+  // Unity builds: splits sources_ into files compiled on their own and
+  // batches of unity_size_ c++ files compiled as one generated source.
+  void UnitySources(std::vector<Resource>* singles,
+                    std::vector<std::vector<Resource> >* batches) const;
+  Resource UnitySource(int index,
+                       const std::vector<Resource>& batch) const;
+  void WriteUnitySource(const Resource& unity,
+                        const std::vector<Resource>& batch,
+                        Makefile* out) const;
+
+  // Replaces our compiled (non ephemeral) objects with
+  // DevSharedLibrary() or ThinArchive(), if enabled.
+  void ArchiveObjects(const ResourceFileSet& compiled,
+                      ResourceFileSet* objects) const;
+  Resource ThinArchive() const;
+  Resource DevSharedLibrary() const;
+
+  // Link inputs (objects/archives) in link order, wrapping alwayslink
+  // resources in whole-archive flags. With --cc_link_response_files they
+  // are written to "response_file" and "@response_file" is returned.
+  // If "whole_archives", every archive is linked whole (shared libs).
+  std::string WriteLinkInputs(const ResourceFileSet& objects,
+                              bool whole_archives,
+                              const Resource& response_file,
+                              Makefile* out) const;
+
+  // Precompiled header (cc_pch), used by our c++ sources.
+  Resource PchSymlink() const;
+  Resource PchOutput() const;
+  void WritePch(const ResourceFileSet& input_files, Makefile* out) const;
+
+  // C++20 modules (cc_module_interfaces, cc_header_units). If a target
+  // sees any module, those of its c++ sources that import one (or are
+  // module units) are compiled with ModuleFlags(): $(CXX_MODULE_FLAGS) and
+  // the module map of all visible BMIs. Such targets skip unity builds.
+  bool UsesCxxModules() const;
+  std::string ModuleFlags() const;
+  Resource ModuleBmi(const std::string& name) const;
+  Resource HeaderUnitBmi(const Resource& header) const;
+  Resource ModuleMap() const;  // gcc mapper, "<map>.clang": clang flags.
+  void WriteModules(const ResourceFileSet& input_files, Makefile* out) const;
+  void WriteModuleInterface(const std::string& name,
+                            const Resource& source,
+                            const std::string& dependencies,
+                            Makefile* out) const;
+
+  // Make variable, 1 if $(CXX) is gcc (see WriteMakeHead).
+  static const char kCxxGcc[];
+
   void AddVariable(const std::string& cpp_name,
                    const std::string& c_name,
                    const std::string& gcc_value,
@@ -65,6 +133,16 @@ class CCLibraryNode : public Node {
 
   std::vector<std::string> cc_include_dirs_;
 
+  int unity_size_;  // <= 1 means no unity build.
+  std::set<std::string> unity_exclude_;
+
+  Resource pch_;  // empty path == none.
+  std::map<std::string, Resource> module_interfaces_;  // name -> source.
+  std::vector<Resource> header_units_;
+  bool thin_archive_;
+  bool dev_shared_;  // --cc_dev_shared_libraries.
+  mutable bool cxx_modules_known_, uses_cxx_modules_;  // UsesCxxModules().
+
   std::vector<std::string> cc_compile_args_;
   std::vector<std::string> header_compile_args_;
   std::vector<std::string> cc_linker_args_;
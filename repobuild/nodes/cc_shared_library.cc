@@ -3,7 +3,6 @@
 //
 // TODO(cvanarsdale): This overlaps a bunch with cc_binary.
 
-#include <algorithm>
 #include <set>
 #include <string>
 #include <vector>
@@ -27,10 +26,12 @@ namespace {
 const char kCxxGcc[] = "CXX_GCC";
 const char kIsDarwin[] = "IS_DARWIN";
 const char kIsDarwinAndClang[] = "IS_DARWIN_AND_CLANG";
+const char kLdVersion[] = "LD_VERSION";
 }
 
 void CCSharedLibraryNode::Parse(BuildFile* file, const BuildFileNode& input) {
   CCLibraryNode::Parse(file, input);
+  thin_archive_ = dev_shared_ = false;  // we link our own objects.
 
   // cc_sources
   vector<Resource> tmp_symbols;
@@ -115,20 +116,19 @@ void CCSharedLibraryNode::WriteLink(Makefile* out) const {
   set<string> flags;
   LinkFlags(CPP, &flags);
 
-  // Link rule
+  // Objects, possibly in a response file. Archives are linked whole, as
+  // the shared library exports everything.
   Resource file = OutLinkedObj();
+  Resource response_file = Resource::FromRootPath(file.path() + ".rsp");
+  string obj_list = WriteLinkInputs(objects, true, response_file, out);
+
+  // Link rule
   Makefile::Rule* rule = out->StartRule(file.path(),
                                         strings::JoinAll(objects.files(), " "));
+  if (input().cc_link_response_files()) {
+    rule->AddDependency(response_file.path());
+  }
   rule->WriteUserEcho("Linking", file.path());
-
-  // HACK(cvanarsdale):
-  // Sadly order matters to the (gcc) linker. It looks in later object
-  // files to find unresolved symbols. We collect the dependencies
-  // bottom up, so we push resources onto the front of the list so
-  // unencumbered resources end up in the back of the list.
-  vector<Resource> copy = objects.files();
-  std::reverse(copy.begin(), copy.end());
-  string obj_list = strings::JoinAll(copy, " ");
   string exported_symbols;
   if (!exported_symbols_.path().empty()) {
     exported_symbols = strings::StringPrintf(
@@ -250,6 +250,32 @@ void CCSharedLibraryNode::WriteMakeHead(const Input& input, Makefile* out) {
   out->append("\tSHARED_LIB_NAME:=awk '{print \"lib\"$$1\".so\"}'\n");
 
   out->append("endif\n");
+
+  // Linker specific flags, ld64 (Darwin), lld and gold/bfd (with the LLVM
+  // plugin) each spell these differently, or lack them.
+  out->append(string(kLdVersion) + " := $(shell $(CXX) "
+              "$(filter -fuse-ld=%,$(LDFLAGS)) -Wl,--version 2>/dev/null | "
+              "head -n 1)\n");
+  out->append("ifeq ($(" + string(kIsDarwin) + "),1)\n");
+  out->append("\tTHINLTO_CACHE_FLAGS = -Wl,-cache_path_lto,$(1)\n");
+  out->append("else ifneq ($(findstring LLD,$(" + string(kLdVersion) +
+              ")),)\n");
+  out->append("\tTHINLTO_CACHE_FLAGS = -Wl,--thinlto-cache-dir=$(1)\n");
+  out->append("else\n");
+  out->append("\tTHINLTO_CACHE_FLAGS = -Wl,-plugin-opt,cache-dir=$(1)\n");
+  out->append("endif\n");
+  out->append("ifneq ($(findstring LLD,$(" + string(kLdVersion) + "))"
+              "$(findstring gold,$(" + string(kLdVersion) + ")),)\n");
+  out->append("\tLD_GDB_INDEX := -Wl,--gdb-index\n");
+  out->append("endif\n");
+
+  // --cc_dev_shared_libraries: an rpath to the .so files, which ELF linkers
+  // must also keep when only static registration refers to them.
+  out->append("ifeq ($(" + string(kIsDarwin) + "),1)\n");
+  out->append("\tDEV_SHARED_LDFLAGS = -Wl,-rpath,$(1)\n");
+  out->append("else\n");
+  out->append("\tDEV_SHARED_LDFLAGS = -Wl,-rpath,$(1) -Wl,--no-as-needed\n");
+  out->append("endif\n");
 }
 
 void CCSharedLibraryNode::ObjectFiles(LanguageType lang,
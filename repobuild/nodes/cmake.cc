@@ -12,6 +12,7 @@
 #include "repobuild/nodes/cmake.h"
 #include "repobuild/nodes/gen_sh.h"
 #include "repobuild/nodes/make.h"
+#include "repobuild/nodes/util.h"
 #include "repobuild/reader/buildfile.h"
 
 using std::map;
@@ -42,6 +43,9 @@ void CmakeNode::Parse(BuildFile* file, const BuildFileNode& input) {
   // Generate the output files.
   GenShNode* gen = NewSubNodeWithCurrentDeps<GenShNode>(file);
   gen->SetMakeName("Cmake");
+  bool strict_inputs = false;
+  current_reader()->ParseBoolField("strict_inputs", &strict_inputs);
+  gen->SetStrictInputs(strict_inputs);
 
   // Users are allowed to specify custom env arg overrides.
   string user_env;
@@ -67,8 +71,23 @@ void CmakeNode::Parse(BuildFile* file, const BuildFileNode& input) {
   for (const string& it : cmake_args) {
     cmake_cmd.append(" " + it);
   }
+  // Configure only reruns if its own inputs changed ("configure_cache").
+  bool configure_cache = true;
+  current_reader()->ParseBoolField("configure_cache", &configure_cache);
+  string command = build_env + " " + cmake_cmd;
+  if (configure_cache) {
+    command = NodeUtil::CachedConfigureCommand(
+        "$(cmake --version) " + strings::JoinAll(cmake_envs, " ") + " " +
+        cmake_cmd,
+        "$BASE",
+        "-name CMakeLists.txt -o -name \"*.cmake\" -o -name \"*.in\"",
+        "$GEN_DIR/build/Makefile",
+        "$GEN_DIR/build/CMakeCache.txt",
+        command,
+        false);  // gen_sh escapes everything.
+  }
   vector<Resource> input_files, output_files;
-  gen->Set(build_setup + "; " + build_env + " " + cmake_cmd,
+  gen->Set(build_setup + "; " + command,
            "",  // clean
            input_files,
            output_files);
@@ -4,11 +4,13 @@
 #include <set>
 #include <string>
 #include <vector>
+#include "common/log/log.h"
 #include "repobuild/env/input.h"
 #include "repobuild/env/resource.h"
 #include "repobuild/nodes/execute_test.h"
 #include "repobuild/nodes/gen_sh.h"
 
+using std::map;
 using std::set;
 using std::string;
 using std::vector;
@@ -21,7 +23,10 @@ ExecuteTestNode::ExecuteTestNode(const TargetInfo& target,
     : Node(target.GetParallelTarget(target.local_path() + ".test"),
            input,
            source),
-      orig_target_(target) {
+      orig_target_(target),
+      binary_node_(NULL),
+      timeout_secs_(0),
+      shard_count_(1) {
 }
 
 ExecuteTestNode::~ExecuteTestNode() {
@@ -36,11 +41,71 @@ void ExecuteTestNode::LocalTests(LanguageType lang,
   targets->insert(target().make_path());
 }
 
+void ExecuteTestNode::TestSpecs(vector<TestSpec>* specs) const {
+  map<string, string> env;
+  EnvVariables(NO_LANG, &env);
+
+  // With --cc_dev_shared_libraries the binary loads our dependencies at run
+  // time, so they are inputs of the test run (and its cache key). Only known
+  // once the dependency graph is complete, not while we are parsed.
+  ResourceFileSet dev_shared;
+  if (binary_node_ != NULL) {
+    ResourceFileSet objects;
+    binary_node_->ObjectFiles(Node::CPP, &objects);
+    for (const Resource& r : objects) {
+      if (r.has_tag("dev_shared")) {
+        dev_shared.Add(r);
+      }
+    }
+  }
+
+  for (const Resource& r : binaries_) {
+    TestSpec spec;
+    spec.name = target().make_path();
+    if (binaries_.files().size() > 1) {
+      spec.name += "." + r.basename();
+    }
+    spec.binary = r.path();
+    spec.dir = target().dir();
+    spec.gen_dir = GenDir();
+    spec.obj_dir = ObjectDir();
+    spec.src_dir = SourceDir();
+    for (const Resource& d : binaries_) {
+      if (d.path() != r.path()) {
+        spec.data.push_back(d.path());
+      }
+    }
+    for (const Resource& d : data_) {
+      spec.data.push_back(d.path());
+    }
+    for (const Resource& d : dev_shared) {
+      spec.data.push_back(d.path());
+    }
+    spec.env = env;
+    spec.timeout_secs = timeout_secs_;
+    spec.shard_count = shard_count_;
+    specs->push_back(spec);
+  }
+}
+
+void ExecuteTestNode::ParseTestOptions(const BuildFileNode& input) {
+  // Through current_reader(), so the "test_data" globs are part of our
+  // SourceGlobs (--affected_files).
+  InitBuildReader(input);
+  current_reader()->ParseIntField("test_timeout", &timeout_secs_);
+  current_reader()->ParseIntField("test_shards", &shard_count_);
+  vector<Resource> data;
+  current_reader()->ParseRepeatedFiles("test_data", &data);
+  data_.AddRange(data);
+  LOG_IF(FATAL, shard_count_ < 1 || timeout_secs_ < 0)
+      << "Invalid test_shards/test_timeout for " << target().full_path();
+}
+
 void ExecuteTestNode::AddShNodes(BuildFile* file, Node* binary_node) {
-  ResourceFileSet binaries;
-  binary_node->TopTestBinaries(Node::NO_LANG, &binaries);
+  binary_node_ = binary_node;
+  binary_node->TopTestBinaries(Node::NO_LANG, &binaries_);
 
-  for (const Resource& r : binaries) {
+  for (const Resource& r : binaries_) {
     GenShNode* node = NewSubNode<GenShNode>(file);
     node->SetMakeName("Testing");
     node->SetMakeTarget(r.path());
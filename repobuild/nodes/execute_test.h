@@ -25,11 +25,17 @@ class ExecuteTestNode : public Node {
   virtual void LocalWriteMake(Makefile* out) const;
   virtual void LocalTests(LanguageType lang,
                           std::set<std::string>* targets) const;
+  virtual void TestSpecs(std::vector<TestSpec>* specs) const;
 
  protected:
   void AddShNodes(BuildFile* file, Node* binary_node);
+  void ParseTestOptions(const BuildFileNode& input);
 
   TargetInfo orig_target_;
+  const Node* binary_node_;  // our subnode.
+  ResourceFileSet binaries_;
+  ResourceFileSet data_;
+  int timeout_secs_, shard_count_;
 };
 
 template <class T>
@@ -50,6 +56,7 @@ class ExecuteTestNodeImpl : public ExecuteTestNode {
 
     // test node.
     AddShNodes(file, subnode);
+    ParseTestOptions(input);
   }
 };
 
@@ -19,6 +19,15 @@ DEFINE_bool(silent_gensh, true,
             "If true, we only print out gen_sh stderr/stdout on "
             "script failures.");
 
+DEFINE_bool(gensh_strict_inputs, false,
+            "If true, every gen_sh (and make, cmake, autoconf) target "
+            "behaves as if it had \"strict_inputs\": true.");
+
+DEFINE_bool(gensh_early_cutoff, true,
+            "If true, gen_sh outputs that a script rewrites with identical "
+            "contents keep their old timestamp, so their dependents are "
+            "not rebuilt.");
+
 using std::map;
 using std::string;
 using std::vector;
@@ -38,6 +47,7 @@ void GenShNode::Parse(BuildFile* file, const BuildFileNode& input) {
   current_reader()->ParseStringField("clean", false, &clean_cmd_);
   current_reader()->ParseRepeatedFiles("input_files", &input_files_);
   current_reader()->ParseRepeatedFiles("outs", false, &outputs_);
+  current_reader()->ParseBoolField("strict_inputs", &strict_inputs_);
 }
 
 void GenShNode::Set(const string& build_cmd,
@@ -59,54 +69,35 @@ void GenShNode::WriteMakeHead(const Input& input, Makefile* out) {
 void GenShNode::LocalWriteMake(Makefile* out) const {
   Resource touchfile = Touchfile();
 
-  // Inputs
-  ResourceFileSet input_files;
-  InputDependencyFiles(NO_LANG, &input_files);  // all but our own.
+  if (Batched()) {
+    WriteBatch(out);
+  } else {
+    Makefile::Rule* rule = out->StartRule(touchfile.path(), RuleInputs());
 
-  ResourceFileSet obj_files;
-  ObjectFiles(NO_LANG, &obj_files);
+    // Build command.
+    if (!build_cmd_.empty()) {
+      rule->WriteUserEcho(make_name_, make_target_);
 
-  // Make target
-  Makefile::Rule* rule = out->StartRule(touchfile.path(), strings::JoinWith(
-      " ",
-      strings::JoinAll(input_files.files(), " "),
-      strings::JoinAll(obj_files.files(), " "),
-      strings::JoinAll(input_files_, " ")));
-
-  // Build command.
-  if (!build_cmd_.empty()) {
-    rule->WriteUserEcho(make_name_, make_target_);
-
-    // The file we touch after the script runs, for 'make' to be happy.
-    string touch_cmd = "mkdir -p " +
-        strings::JoinPath(input().object_dir(), target().dir()) +
-        "; touch " + touchfile.path();
-
-    // Compute the build command prefix.
-    string prefix;
-    {
-      set<string> compile_flags;
-      CompileFlags(CPP, &compile_flags);
-      prefix = "DEP_CXXFLAGS=\"" + strings::JoinAll(compile_flags, " ") + "\"";
-      compile_flags.clear();
-      CompileFlags(C_LANG, &compile_flags);
-      prefix += " DEP_CFLAGS=\"" + strings::JoinAll(compile_flags, " ") + "\"";
-    }
+      // The file we touch after the script runs, for 'make' to be happy.
+      string touch_cmd = "mkdir -p " +
+          strings::JoinPath(input().object_dir(), target().dir()) +
+          "; touch " + touchfile.path();
 
-    // Compute environment variables for shell.
-    map<string, string> env_vars;
-    EnvVariables(NO_LANG, &env_vars);
-    for (auto it : local_env_vars_) {  // local vars override inherited ones.
-      env_vars[it.first] = it.second;
+      // This is a hack for now.
+      string command = strings::ReplaceAll(
+          build_cmd_, "$(ROOT_DIR)", "$ROOT_DIR");
+      string outputs = strings::JoinAll(outputs_, " ");
+      string snapshot = Touchfile(".outputs").path();
+      if (EarlyCutoff()) {
+        rule->WriteCommand(SnapshotOutputsCommand(outputs, snapshot));
+      }
+      rule->WriteCommand(FullCommand(command, "", touch_cmd));
+      if (EarlyCutoff()) {
+        rule->WriteCommand(RestoreOutputsCommand(outputs, snapshot));
+      }
     }
-
-    // Now write the actual comment.
-    // This is a hack for now.
-    string command = strings::ReplaceAll(
-        build_cmd_, "$(ROOT_DIR)", "$ROOT_DIR");
-    rule->WriteCommand(WriteCommand(env_vars, prefix, command, touch_cmd));
+    out->FinishRule(rule);
   }
-  out->FinishRule(rule);
 
   {  // user target
     ResourceFileSet output_targets;
@@ -115,8 +106,149 @@ void GenShNode::LocalWriteMake(Makefile* out) const {
   }
 
   for (const Resource& resource : outputs_) {
-    out->WriteRule(resource.path(), touchfile.path());
+    Makefile::Rule* rule = out->StartRule(resource.path(), touchfile.path());
+    if (EarlyCutoff()) {
+      // Any recipe makes make re-stat the output after running it, so
+      // dependents only rebuild if its timestamp actually moved.
+      rule->WriteCommand("true");
+    }
+    out->FinishRule(rule);
+  }
+}
+
+string GenShNode::RuleInputs() const {
+  ResourceFileSet input_files, obj_files;
+  if (StrictInputs() || Batched()) {
+    DirectDependencyFiles(NO_LANG, &input_files);  // + input_files_ below.
+  } else {
+    InputDependencyFiles(NO_LANG, &input_files);  // all but our own.
+    ObjectFiles(NO_LANG, &obj_files);
+  }
+  return strings::JoinWith(
+      " ",
+      strings::JoinAll(input_files.files(), " "),
+      strings::JoinAll(obj_files.files(), " "),
+      strings::JoinAll(input_files_, " "));
+}
+
+string GenShNode::FullCommand(const string& cmd,
+                              const string& raw_args,
+                              const string& admin_cmd) const {
+  // Compute the build command prefix.
+  string prefix;
+  {
+    set<string> compile_flags;
+    CompileFlags(CPP, &compile_flags);
+    prefix = "DEP_CXXFLAGS=\"" + strings::JoinAll(compile_flags, " ") + "\"";
+    compile_flags.clear();
+    CompileFlags(C_LANG, &compile_flags);
+    prefix += " DEP_CFLAGS=\"" + strings::JoinAll(compile_flags, " ") + "\"";
+  }
+  return WriteCommand(BuildEnv(), prefix, cmd, raw_args, admin_cmd);
+}
+
+map<string, string> GenShNode::BuildEnv() const {
+  // Compute environment variables for shell.
+  map<string, string> env_vars;
+  EnvVariables(NO_LANG, &env_vars);
+  for (auto it : local_env_vars_) {  // local vars override inherited ones.
+    env_vars[it.first] = it.second;
+  }
+  return env_vars;
+}
+
+void GenShNode::SetBatch(const string& batch_cmd,
+                         const vector<string>& batch_args) {
+  batch_cmd_ = batch_cmd;
+  batch_args_ = batch_args;
+}
+
+string GenShNode::BatchName() const {
+  // Everything that has to match for two nodes to share a run.
+  string key = batch_cmd_ + '\0' + make_name_;
+  if (cd_) {
+    key += '\0' + target().dir();
+  }
+  for (const auto& it : BuildEnv()) {
+    key += '\0' + it.first + '=' + it.second;
+  }
+  unsigned long long hash = 14695981039346656037ULL;  // FNV-1a
+  for (char c : key) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+  }
+  return strings::StringPrintf("BATCH_%016llx", hash);
+}
+
+void GenShNode::WriteBatch(Makefile* out) const {
+  // Each member adds its arguments, outputs and inputs to the batch; the
+  // first one also writes its recipe (expanded once make has read them
+  // all). Inputs that other members produce are dropped, those are only
+  // ordering constraints between members of the same run.
+  string var = BatchName();
+  Resource stamp = Resource::FromLocalPath(
+      strings::JoinPath(input().object_dir(), ".batches"), var);
+  Resource touchfile = Touchfile();
+  out->append("\n" + var + "_ARGS += " +
+              strings::JoinAll(batch_args_, " ") + "\n");
+  out->append(var + "_OUTPUTS += " + strings::JoinAll(outputs_, " ") + "\n");
+  out->append(var + "_PRODUCTS += " + strings::JoinAll(outputs_, " ") + " " +
+              touchfile.path() + "\n");
+
+  bool first = !out->seen_rule(stamp.path());
+  Makefile::Rule* rule = out->StartRule(
+      stamp.path(),
+      "$(filter-out $(" + var + "_PRODUCTS)," + RuleInputs() + ")");
+  if (first) {
+    rule->WriteUserEcho(make_name_, "$(words $(" + var + "_ARGS)) files");
+    string command = strings::ReplaceAll(
+        batch_cmd_, "$(ROOT_DIR)", "$ROOT_DIR");
+    string outputs = "$(" + var + "_OUTPUTS)";
+    string snapshot = stamp.path() + ".outputs";
+    if (FLAGS_gensh_early_cutoff) {
+      rule->WriteCommand(SnapshotOutputsCommand(outputs, snapshot));
+    }
+    rule->WriteCommand(FullCommand(command,
+                                   "$(" + var + "_ARGS)",
+                                   "mkdir -p " + stamp.dirname() +
+                                   "; touch " + stamp.path()));
+    if (FLAGS_gensh_early_cutoff) {
+      rule->WriteCommand(RestoreOutputsCommand(outputs, snapshot));
+    }
   }
+  out->FinishRule(rule);
+
+  rule = out->StartRule(touchfile.path(), stamp.path());
+  rule->WriteCommand("mkdir -p " + touchfile.dirname());
+  rule->WriteCommand("touch " + touchfile.path());
+  out->FinishRule(rule);
+}
+
+bool GenShNode::StrictInputs() const {
+  return strict_inputs_ || FLAGS_gensh_strict_inputs;
+}
+
+bool GenShNode::EarlyCutoff() const {
+  return FLAGS_gensh_early_cutoff && !outputs_.empty();
+}
+
+string GenShNode::SnapshotOutputsCommand(const string& outputs,
+                                         const string& dir) const {
+  // Checksum and timestamp (reference file) of each existing output.
+  return "rm -rf " + dir + " && mkdir -p " + dir + " && i=0; for f in " +
+      outputs + "; do i=$$((i+1)); "
+      "if [ -f $$f ]; then cksum < $$f > " + dir + "/$$i.sum && "
+      "touch -r $$f " + dir + "/$$i.ref; fi; done";
+}
+
+string GenShNode::RestoreOutputsCommand(const string& outputs,
+                                        const string& dir) const {
+  // Unchanged outputs get their old timestamp back, anything else is
+  // touched (in case the script preserved an old timestamp, e.g. cp -p).
+  return "i=0; for f in " + outputs + "; do "
+      "i=$$((i+1)); if [ -f $$f ] && [ -f " + dir + "/$$i.sum ] && "
+      "cksum < $$f | cmp -s - " + dir + "/$$i.sum; then "
+      "touch -r " + dir + "/$$i.ref $$f; elif [ -e $$f ]; then touch $$f; "
+      "fi; done";
 }
 
 void GenShNode::LocalWriteMakeClean(Makefile::Rule* rule) const {
@@ -126,7 +258,8 @@ void GenShNode::LocalWriteMakeClean(Makefile::Rule* rule) const {
 
   map<string, string> env_vars;
   EnvVariables(NO_LANG, &env_vars);
-  rule->WriteCommandBestEffort(WriteCommand(env_vars, "", clean_cmd_, ""));
+  rule->WriteCommandBestEffort(
+      WriteCommand(env_vars, "", clean_cmd_, "", ""));
 }
 
 namespace {
@@ -145,6 +278,7 @@ string JoinRoot(const string& path) {
 string GenShNode::WriteCommand(const map<string, string>& env_vars,
                                const string& prefix,
                                const string& cmd,
+                               const string& raw_args,
                                const string& admin_cmd) const {
   string out;
   out.append("(mkdir -p ");
@@ -168,6 +302,9 @@ string GenShNode::WriteCommand(const map<string, string>& env_vars,
   AddEnvVar("CFLAGS", &out);
   AddEnvVar("BASIC_CFLAGS", &out);
   AddEnvVar("LDFLAGS", &out);
+  // NB: Referencing $(MAKE) also makes GNU make treat the recipe as a
+  // recursive make and hand the script its jobserver, which sub-makes
+  // (make, cmake and autoconf nodes) then share with us.
   AddEnvVar("MAKE", &out);
   for (const auto& it : env_vars) {
     out.append(" ");
@@ -188,6 +325,9 @@ string GenShNode::WriteCommand(const map<string, string>& env_vars,
   } else {
     out.append(cmd);
   }
+  if (!raw_args.empty()) {
+    out.append(" " + raw_args);
+  }
   out.append(")'");
 
   // Logfile, if any
@@ -210,7 +350,13 @@ string GenShNode::WriteCommand(const map<string, string>& env_vars,
 
 void GenShNode::LocalDependencyFiles(LanguageType lang,
                                      ResourceFileSet* files) const {
-  files->Add(Touchfile());
+  if (EarlyCutoff()) {
+    for (const Resource& output : outputs_) {
+      files->Add(output);
+    }
+  } else {
+    files->Add(Touchfile());
+  }
 }
 
 }  // namespace repobuild
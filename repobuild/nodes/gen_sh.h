@@ -21,7 +21,8 @@ class GenShNode : public Node {
         cd_(true),
         make_name_("Script"),
         make_target_(t.full_path()),
-        escape_command_(true) {
+        escape_command_(true),
+        strict_inputs_(false) {
   }
   virtual ~GenShNode() {}
   virtual std::string Name() const { return "gen_sh"; }
@@ -39,25 +40,55 @@ class GenShNode : public Node {
     local_env_vars_[var] = val;
   }
   void SetMakefileEscape(bool escape) { escape_command_ = escape; }
+  void SetStrictInputs(bool strict) { strict_inputs_ = strict; }
+
+  // Batching: gen_sh nodes with the same batch_cmd (and environment) run
+  // it once, with all of their batch_args appended, instead of build_cmd.
+  // The batch only reruns on the inputs strict_inputs would consider.
+  void SetBatch(const std::string& batch_cmd,
+                const std::vector<std::string>& batch_args);
 
   // Static preprocessors
   static void WriteMakeHead(const Input& input, Makefile* out);
 
   std::string Logfile() const;
 
+  // Strict inputs ("strict_inputs" or --gensh_strict_inputs): our script
+  // only reruns when its declared input files or the outputs (binaries,
+  // generated files) of our direct dependencies change.
+  bool StrictInputs() const;
+
  protected:
   std::string WriteCommand(const std::map<std::string, std::string>& env_vars,
                            const std::string& prefix,
                            const std::string& cmd,
+                           const std::string& raw_args,  // not escaped.
                            const std::string& admin_cmd) const;
+  std::string FullCommand(const std::string& cmd,
+                          const std::string& raw_args,
+                          const std::string& admin_cmd) const;
+  std::map<std::string, std::string> BuildEnv() const;
+  std::string RuleInputs() const;
 
   virtual void LocalWriteMakeClean(Makefile::Rule* out) const;
   virtual void LocalWriteMake(Makefile* out) const;
   virtual void LocalDependencyFiles(LanguageType lang,
                                     ResourceFileSet* files) const;
 
+  // Early cutoff (--gensh_early_cutoff): dependents depend on our
+  // declared outputs, which only change timestamp if their contents did.
+  bool EarlyCutoff() const;
+  std::string SnapshotOutputsCommand(const std::string& outputs,
+                                     const std::string& dir) const;
+  std::string RestoreOutputsCommand(const std::string& outputs,
+                                    const std::string& dir) const;
+
+  bool Batched() const { return !batch_cmd_.empty(); }
+  std::string BatchName() const;
+  void WriteBatch(Makefile* out) const;
+
   // NB: We intentionally do not pass on files, and rely soley
-  // on our "touchfile'.
+  // on our "touchfile' (or outputs).
   virtual bool IncludeDependencies(DependencyCollectionType type,
                                    LanguageType lang) const {
     return (type == BINARIES ||
@@ -72,6 +103,9 @@ class GenShNode : public Node {
   bool cd_;
   std::string make_name_, make_target_;
   bool escape_command_;
+  bool strict_inputs_;
+  std::string batch_cmd_;
+  std::vector<std::string> batch_args_;
 };
 
 }  // namespace repobuild
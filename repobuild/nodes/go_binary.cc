@@ -1,6 +1,7 @@
 // Copyright 2013
 // Author: Christopher Van Arsdale
 
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
@@ -12,6 +13,7 @@
 #include "repobuild/nodes/top_symlink.h"
 #include "repobuild/reader/buildfile.h"
 
+using std::map;
 using std::string;
 using std::vector;
 using std::set;
@@ -37,10 +39,52 @@ void GoBinaryNode::Parse(BuildFile* file, const BuildFileNode& input) {
 
 void GoBinaryNode::LocalWriteMake(Makefile* out) const {
   GoLibraryNode::LocalWriteMakeInternal(false, out);
-  WriteGoBinary(Binary(), out);
+  if (UseLinkAction()) {
+    WriteGoLink(Binary(), out);
+  } else {
+    WriteGoBinary(Binary(), out);
+  }
   WriteBaseUserTarget(out);
 }
 
+bool GoBinaryNode::UseLinkAction() const {
+  // go_build_args and -G are "go build" flags.
+  return (input().go_package_actions() &&
+          go_build_args_.empty() &&
+          input().flags("-G").empty());
+}
+
+void GoBinaryNode::WriteGoLink(const Resource& bin, Makefile* out) const {
+  // Our main package goes with the other archives, not next to binaries.
+  Resource main = Resource::FromLocalPath(
+      strings::JoinPath(input().object_dir(), "go/bin"),
+      target().make_path() + ".a");
+  WriteCompile("main", main, out);
+
+  // Relink when any package changes, not just the ones we import.
+  map<string, Resource> packages;
+  DependencyPackages(&packages);
+  ResourceFileSet archives;
+  for (const auto& it : packages) {
+    archives.Add(it.second);
+  }
+
+  Makefile::Rule* rule = out->StartRule(
+      bin.path(),
+      strings::JoinWith(" ",
+                        main.path(),
+                        strings::JoinAll(archives.files(), " ")));
+  rule->WriteUserEcho("Linking", bin.path());
+  rule->WriteCommand("mkdir -p " + bin.dirname());
+  rule->WriteCommand(strings::JoinWith(
+      " ",
+      "go tool link -buildmode=exe",
+      "-importcfg", Importcfg(main).path(),
+      "-o", bin.path(),
+      main.path()));
+  out->FinishRule(rule);
+}
+
 void GoBinaryNode::WriteGoBinary(const Resource& bin, Makefile* out) const {
   // Source files.
   ResourceFileSet deps;
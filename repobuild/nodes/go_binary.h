@@ -27,6 +27,9 @@ class GoBinaryNode : public GoLibraryNode {
                              LanguageType lang) const;
 
  protected:
+  virtual bool IsGoPackage() const { return false; }
+  bool UseLinkAction() const;
+  void WriteGoLink(const Resource& bin, Makefile* out) const;
   void WriteGoBinary(const Resource& bin, Makefile* out) const;
   Resource Binary() const;
 
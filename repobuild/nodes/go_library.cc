@@ -3,9 +3,11 @@
 //
 // TODO(cvanarsdale): This overalaps a lot with py_library.
 
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
+#include "common/log/log.h"
 #include "common/strings/strutil.h"
 #include "common/strings/path.h"
 #include "repobuild/env/input.h"
@@ -14,11 +16,23 @@
 #include "repobuild/nodes/util.h"
 #include "repobuild/reader/buildfile.h"
 
+using std::map;
 using std::vector;
 using std::string;
 using std::set;
 
 namespace repobuild {
+namespace {
+const char kGoStdMissing[] = "GO_STD_MISSING";
+
+// Go wants absolute paths in GOPATH and GOCACHE.
+string AbsolutePath(const string& path) {
+  if (strings::HasPrefix(path, "/")) {
+    return path;
+  }
+  return "$(pwd)/" + path;
+}
+}  // anonymous namespace
 
 GoLibraryNode::GoLibraryNode(const TargetInfo& t,
                              const Input& i,
@@ -51,6 +65,13 @@ void GoLibraryNode::Set(const vector<Resource>& sources) {
   Init();
 }
 
+void GoLibraryNode::LocalWriteMake(Makefile* out) const {
+  if (UsePackageActions()) {
+    WriteCompile(ImportPath(input(), PackageDir()), Archive(), out);
+  }
+  LocalWriteMakeInternal(true, out);
+}
+
 void GoLibraryNode::LocalWriteMakeInternal(bool write_user_target,
                                            Makefile* out) const {
   // Move all go code into a single directory.
@@ -65,12 +86,11 @@ void GoLibraryNode::LocalWriteMakeInternal(bool write_user_target,
   Makefile::Rule* rule = out->StartRule(
       touchfile_.path(),
       strings::JoinAll(symlinked_sources, " "));
-  rule->WriteUserEcho("Compiling", target().full_path() + " (go)");
   if (!sources_.empty()) {
-    for (const Resource& r : symlinked_sources) {
-      rule->WriteCommand(GoBuildPrefix() + " gofmt " +
-                        r.path() + " > /dev/null");
-    }
+    rule->WriteUserEcho("Checking", target().full_path() + " (gofmt)");
+    rule->WriteCommand(GoBuildPrefix() + " gofmt -l " +
+                       strings::JoinAll(symlinked_sources, " ") +
+                       " > /dev/null");
   }
   rule->WriteCommand("mkdir -p " + Touchfile().dirname());
   rule->WriteCommand("touch " + Touchfile().path());
@@ -88,6 +108,9 @@ void GoLibraryNode::LocalDependencyFiles(LanguageType lang,
                                          ResourceFileSet* files) const {
   files->AddRange(sources_);
   files->Add(touchfile_);
+  if (UsePackageActions()) {
+    files->Add(Archive());
+  }
 }
 
 void GoLibraryNode::LocalObjectFiles(LanguageType lang,
@@ -111,13 +134,145 @@ Resource GoLibraryNode::GoFileFor(const Resource& r) const {
 }
 
 string GoLibraryNode::GoBuildPrefix() const {
-  if (strings::HasPrefix(input().pkgfile_dir(), "/")) {
-    // If the path is absolute, don't add $PWD.
-    return Makefile::Escape(
-      "GOPATH=" + input().pkgfile_dir() + ":$GOPATH");
+  // GOPATH mode, with one build cache for all go commands.
+  return Makefile::Escape(strings::JoinWith(
+      " ",
+      "GO111MODULE=off",
+      "GOPATH=" + AbsolutePath(input().pkgfile_dir()) + ":$GOPATH",
+      "GOCACHE=" + AbsolutePath(
+          strings::JoinPath(input().object_dir(), "go/cache"))));
+}
+
+bool GoLibraryNode::UsePackageActions() const {
+  return input().go_package_actions() && IsGoPackage() && !sources_.empty();
+}
+
+string GoLibraryNode::PackageDir() const {
+  set<string> dirs;
+  for (const Resource& r : sources_) {
+    dirs.insert(GoFileFor(r).dirname());
+  }
+  LOG_IF(FATAL, dirs.size() != 1)
+      << "go sources of " << target().full_path() << " span "
+      << dirs.size() << " packages, which --go_package_actions does not "
+      << "support (one go_library per package).";
+  return *dirs.begin();
+}
+
+Resource GoLibraryNode::Archive() const {
+  return ArchiveFor(input(), PackageDir());
+}
+
+Resource GoLibraryNode::Importcfg(const Resource& archive) const {
+  return Resource::FromRootPath(archive.path() + ".importcfg");
+}
+
+void GoLibraryNode::WriteCompile(const string& package,
+                                 const Resource& archive,
+                                 Makefile* out) const {
+  LOG_IF(FATAL, out->seen_rule(archive.path()))
+      << "go package " << package << " is built by more than one target ("
+      << target().full_path() << "), see --go_package_actions.";
+
+  // The standard library, compiled once into our build cache. Listed
+  // again when the toolchain changes, or when its export files are gone
+  // (e.g. "go clean -cache"): then the (phony) check target is a
+  // prerequisite, and the cmp below keeps archives from recompiling.
+  Resource std_cfg = StdImportcfg(input());
+  if (!out->seen_rule(std_cfg.path())) {
+    string check = std_cfg.path() + ".check";
+    out->append(string(kGoStdMissing) + " := $(shell sed -n "
+                "'s/^packagefile [^=]*=//p' " + std_cfg.path() +
+                " 2>/dev/null | while read f; do test -f \"$$f\" || "
+                "{ echo " + check + "; break; }; done)\n");
+    out->append(".PHONY: " + check + "\n");
+    out->append(check + ":\n\n");
+    Makefile::Rule* rule = out->StartRule(
+        std_cfg.path(),
+        strings::JoinWith(" ",
+                          "$(wildcard $(shell go env GOROOT)/VERSION)",
+                          "$(" + string(kGoStdMissing) + ")"));
+    rule->WriteUserEcho("Compiling", "go std");
+    rule->WriteCommand("mkdir -p " + std_cfg.dirname());
+    rule->WriteCommand(
+        GoBuildPrefix() + " go list -export -f "
+        "'{{if .Export}}packagefile {{.ImportPath}}={{.Export}}{{end}}' "
+        "std > " + std_cfg.path() + ".tmp");
+    rule->WriteCommand("cmp -s " + std_cfg.path() + ".tmp " + std_cfg.path() +
+                       " || mv -f " + std_cfg.path() + ".tmp " +
+                       std_cfg.path());
+    out->FinishRule(rule);
+  }
+
+  map<string, Resource> packages;
+  DependencyPackages(&packages);
+  vector<string> packagefiles;
+  for (const auto& it : packages) {
+    packagefiles.push_back(it.first + "=" + it.second.path());
+  }
+
+  ResourceFileSet deps, sources;
+  InputDependencyFiles(GO_LANG, &deps);
+  LocalObjectFiles(GO_LANG, &sources);
+  Resource importcfg = Importcfg(archive);
+  Makefile::Rule* rule = out->StartRule(
+      archive.path(),
+      strings::JoinWith(" ",
+                        std_cfg.path(),
+                        strings::JoinAll(sources.files(), " "),
+                        strings::JoinAll(deps.files(), " ")));
+  rule->WriteUserEcho("Compiling", target().full_path() + " (go)");
+  rule->WriteCommand("mkdir -p " + archive.dirname());
+  string cfg_cmd = "cat " + std_cfg.path();
+  if (!packagefiles.empty()) {
+    cfg_cmd += "; printf 'packagefile %s\\n' " +
+               strings::JoinAll(packagefiles, " ");
   }
-  return Makefile::Escape(
-      "GOPATH=$(pwd)/" + input().pkgfile_dir() + ":$GOPATH");
+  rule->WriteCommand("{ " + cfg_cmd + "; } > " + importcfg.path());
+
+  // "go list" applies build constraints (_test.go, GOOS suffixes, ...).
+  string dir = PackageDir();
+  rule->WriteCommand(strings::JoinWith(
+      " ",
+      "FILES=$$(" + GoBuildPrefix(), "go list -e -f",
+      "'{{range .GoFiles}}" + dir + "/{{.}} {{end}}'",
+      "./" + dir + ");",
+      "go tool compile -p", package,
+      "-importcfg", importcfg.path(),
+      "-pack -o", archive.path(),
+      "$$FILES"));
+  out->FinishRule(rule);
+}
+
+void GoLibraryNode::DependencyPackages(
+    map<string, Resource>* packages) const {
+  ResourceFileSet sources;
+  InputObjectFiles(GO_LANG, &sources);
+  for (const Resource& r : sources.files()) {
+    (*packages)[ImportPath(input(), r.dirname())] =
+        ArchiveFor(input(), r.dirname());
+  }
+}
+
+// static
+Resource GoLibraryNode::ArchiveFor(const Input& input, const string& dir) {
+  return Resource::FromLocalPath(
+      strings::JoinPath(input.object_dir(), "go/pkg"),
+      ImportPath(input, dir) + ".a");
+}
+
+// static
+string GoLibraryNode::ImportPath(const Input& input, const string& dir) {
+  string src = strings::JoinPath(input.pkgfile_dir(), "src") + "/";
+  LOG_IF(FATAL, !strings::HasPrefix(dir, src))
+      << "go package outside of " << src << ": " << dir;
+  return dir.substr(src.size());
+}
+
+// static
+Resource GoLibraryNode::StdImportcfg(const Input& input) {
+  return Resource::FromLocalPath(
+      strings::JoinPath(input.object_dir(), "go"), "std.importcfg");
 }
 
 }  // namespace repobuild
@@ -4,7 +4,9 @@
 #ifndef _REPOBUILD_NODES_GO_LIBRARY_H__
 #define _REPOBUILD_NODES_GO_LIBRARY_H__
 
+#include <map>
 #include <memory>
+#include <string>
 #include <vector>
 #include "repobuild/nodes/node.h"
 #include "repobuild/env/resource.h"
@@ -17,9 +19,7 @@ class GoLibraryNode : public Node {
   GoLibraryNode(const TargetInfo& t, const Input& i, DistSource* s);
   virtual ~GoLibraryNode();
   virtual void Parse(BuildFile* file, const BuildFileNode& input);
-  virtual void LocalWriteMake(Makefile* out) const {
-    LocalWriteMakeInternal(true, out);
-  }
+  virtual void LocalWriteMake(Makefile* out) const;
   virtual void LocalDependencyFiles(LanguageType lang,
                                     ResourceFileSet* files) const;
   virtual void LocalObjectFiles(LanguageType lang,
@@ -34,6 +34,22 @@ class GoLibraryNode : public Node {
   Resource GoFileFor(const Resource& r) const;
   std::string GoBuildPrefix() const;
 
+  // Per-package compilation (--go_package_actions): each package is
+  // compiled by "go tool compile" into its own archive, against an
+  // importcfg listing the standard library and our dependencies.
+  virtual bool IsGoPackage() const { return true; }  // not main/test.
+  bool UsePackageActions() const;
+  std::string PackageDir() const;
+  Resource Archive() const;
+  void WriteCompile(const std::string& package,
+                    const Resource& archive,
+                    Makefile* out) const;
+  Resource Importcfg(const Resource& archive) const;
+  void DependencyPackages(std::map<std::string, Resource>* packages) const;
+  static Resource ArchiveFor(const Input& input, const std::string& dir);
+  static std::string ImportPath(const Input& input, const std::string& dir);
+  static Resource StdImportcfg(const Input& input);
+
   Resource touchfile_;
   std::vector<Resource> sources_;
   std::unique_ptr<ComponentHelper> component_;
@@ -25,6 +25,7 @@ class GoTestNode : public GoLibraryNode {
                           std::set<std::string>* targets) const;
 
  protected:
+  virtual bool IsGoPackage() const { return false; }
   void WriteGoTest(Makefile* out) const;
 
   std::vector<std::string> go_build_args_;
@@ -21,6 +21,102 @@ using std::vector;
 using std::set;
 
 namespace repobuild {
+namespace {
+// Native jar writer (--java_native_jar), shared by all jars.
+string JarWriter(const Input& input) {
+  return strings::JoinPath(input.genfile_dir(), "java_jar/jar_writer.py");
+}
+
+const char kJarWriter[] =
+    "#!/usr/bin/env python3\n"
+    "\"\"\"Jar writer for repobuild java_jar/java_binary (see java_jar.cc).\n"
+    "\n"
+    "Usage: jar_writer.py <jar> <manifest> <class root>...\n"
+    "\n"
+    "Streams every file under the class roots (later roots win) into <jar>,\n"
+    "sorted and with fixed timestamps, after META-INF/MANIFEST.MF. If <jar>\n"
+    "already has exactly these entries (CRC-32 and size), it is left alone,\n"
+    "timestamp included, so nothing downstream changes.\n"
+    "\"\"\"\n"
+    "\n"
+    "import os\n"
+    "import sys\n"
+    "import zipfile\n"
+    "import zlib\n"
+    "\n"
+    "TIMESTAMP = (2010, 1, 1, 0, 0, 0)\n"
+    "SKIP = (\".dummy.touch\",)  # see JavaLibraryNode::RootTouchfile().\n"
+    "MANIFEST = \"META-INF/MANIFEST.MF\"\n"
+    "\n"
+    "\n"
+    "def Crc(path):\n"
+    "  crc = 0\n"
+    "  with open(path, \"rb\") as f:\n"
+    "    for chunk in iter(lambda: f.read(1 << 16), b\"\"):\n"
+    "      crc = zlib.crc32(chunk, crc)\n"
+    "  return crc\n"
+    "\n"
+    "\n"
+    "def Manifest(path):\n"
+    "  lines = [l.rstrip(\"\\r\\n\") for l in open(path)]\n"
+    "  lines = [l for l in lines if l]\n"
+    "  if not any(l.startswith(\"Manifest-Version:\") for l in lines):\n"
+    "    lines.insert(0, \"Manifest-Version: 1.0\")\n"
+    "  return (\"\\n\".join(lines) + \"\\n\\n\").encode()\n"
+    "\n"
+    "\n"
+    "def main(argv):\n"
+    "  jar, manifest, roots = argv[1], argv[2], argv[3:]\n"
+    "  files = {}\n"
+    "  for root in roots:\n"
+    "    for dirpath, _, names in os.walk(root, followlinks=True):\n"
+    "      for name in names:\n"
+    "        path = os.path.join(dirpath, name)\n"
+    "        if name in SKIP or not os.path.isfile(path):\n"
+    "          continue\n"
+    "        files[os.path.relpath(path, root).replace(os.sep, \"/\")] = path\n"
+    "  files.pop(MANIFEST, None)\n"
+    "  manifest_data = Manifest(manifest)\n"
+    "\n"
+    "  # (name, crc, size) of everything we would write.\n"
+    "  entries = [(MANIFEST, zlib.crc32(manifest_data), len(manifest_data))]\n"
+    "  for name in sorted(files):\n"
+    "    entries.append((name, Crc(files[name]),\n"
+    "                    os.path.getsize(files[name])))\n"
+    "\n"
+    "  try:\n"
+    "    with zipfile.ZipFile(jar) as existing:\n"
+    "      if entries == [(i.filename, i.CRC, i.file_size)\n"
+    "                     for i in existing.infolist()]:\n"
+    "        return 0\n"
+    "  except (OSError, zipfile.BadZipFile):\n"
+    "    pass\n"
+    "\n"
+    "  tmp = jar + \".tmp\"\n"
+    "  with zipfile.ZipFile(tmp, \"w\", zipfile.ZIP_DEFLATED) as out:\n"
+    "    for name, _, _ in entries:\n"
+    "      info = zipfile.ZipInfo(name, TIMESTAMP)\n"
+    "      info.compress_type = zipfile.ZIP_DEFLATED\n"
+    "      info.external_attr = 0o644 << 16\n"
+    "      if name == MANIFEST:\n"
+    "        out.writestr(info, manifest_data)\n"
+    "      else:\n"
+    "        with open(files[name], \"rb\") as f:\n"
+    "          out.writestr(info, f.read())\n"
+    "  os.replace(tmp, jar)\n"
+    "  return 0\n"
+    "\n"
+    "\n"
+    "if __name__ == \"__main__\":\n"
+    "  sys.exit(main(sys.argv))\n";
+}  // anonymous namespace
+
+// static
+void JavaJarNode::WriteMakeHead(const Input& input, Makefile* out) {
+  if (input.java_native_jar()) {
+    out->GenerateExecFile("JarWriter", JarWriter(input), kJarWriter);
+  }
+}
 
 void JavaJarNode::Parse(BuildFile* file, const BuildFileNode& input) {
   JavaLibraryNode::Parse(file, input);
@@ -45,6 +141,11 @@ void JavaJarNode::WriteRules(Makefile* out) const {
   ResourceFileSet roots;
   ObjectRoots(JAVA, &roots);
 
+  if (UseNativeJar()) {
+    WriteNativeJar(JarName(), roots, out);
+    return;
+  }
+
   // Move all objects in those directories to our JarRoot.
   ResourceFileSet temp_files;
   for (const Resource& input : roots.files()) {
@@ -111,6 +212,49 @@ void JavaJarNode::WriteJar(const Resource& jar_file,
   out->FinishRule(rule);
 }
 
+bool JavaJarNode::UseNativeJar() const {
+  // The jar tool is still needed for any jar flags (-J, java_linker_flags).
+  set<string> flags;
+  LinkFlags(JAVA, &flags);
+  return input().java_native_jar() && flags.empty() &&
+      input().flags("-J").empty();
+}
+
+void JavaJarNode::WriteNativeJar(const Resource& jar_file,
+                                 const ResourceFileSet& roots,
+                                 Makefile* out) const {
+  Resource manifest = WriteManifest(out);
+
+  // The writer leaves an unchanged jar alone, so like the .api files in
+  // java_library, the jar has a no-op rule that make re-stats after the
+  // .checked touchfile has run.
+  Resource checked = Resource::FromRootPath(jar_file.path() + ".checked");
+  vector<string> dirs;
+  for (const Resource& root : roots.files()) {
+    dirs.push_back(root.dirname());
+  }
+  Makefile::Rule* rule = out->StartRule(
+      checked.path(),
+      strings::JoinWith(" ",
+                        manifest.path(),
+                        JarWriter(input()),
+                        strings::JoinAll(roots.files(), " ")));
+  rule->WriteUserEcho("Jaring", jar_file.path());
+  rule->WriteCommand("mkdir -p " + jar_file.dirname());
+  rule->WriteCommand(strings::JoinWith(
+      " ",
+      JarWriter(input()),
+      jar_file.path(),
+      manifest.path(),
+      strings::JoinAll(dirs, " ")));
+  rule->WriteCommand("touch " + checked.path());
+  out->FinishRule(rule);
+
+  rule = out->StartRule(jar_file.path(), checked.path());
+  rule->WriteCommand("true");
+  out->FinishRule(rule);
+}
+
 Resource JavaJarNode::WriteManifest(Makefile* out) const {
   Resource manifest = Resource::FromLocalPath(
       strings::JoinPath(input().genfile_dir(),
@@ -21,6 +21,7 @@ class JavaJarNode : public JavaLibraryNode {
   virtual ~JavaJarNode() {}
   virtual void Parse(BuildFile* file, const BuildFileNode& input);
   virtual void LocalWriteMake(Makefile* out) const;
+  static void WriteMakeHead(const Input& input, Makefile* out);
 
  protected:
   // Helper.
@@ -36,6 +37,10 @@ class JavaJarNode : public JavaLibraryNode {
                      const Resource& dir,
                      Makefile* out) const;
   Resource WriteManifest(Makefile* out) const;
+  bool UseNativeJar() const;
+  void WriteNativeJar(const Resource& jar_file,
+                      const ResourceFileSet& roots,
+                      Makefile* out) const;
 
   std::vector<std::string> java_manifest_;
 };
@@ -18,6 +18,212 @@ using std::string;
 using std::set;
 
 namespace repobuild {
+namespace {
+// Compile server (--java_compile_server): javac runs in one long-lived
+// JVM, which our client (called by make instead of javac) talks to.
+string ServerSource(const Input& input) {
+  return strings::JoinPath(input.genfile_dir(),
+                           "javac_server/JavacServer.java");
+}
+string ClientScript(const Input& input) {
+  return strings::JoinPath(input.genfile_dir(),
+                           "javac_server/javac_client.py");
+}
+string ServerStateDir(const Input& input) {
+  return strings::JoinPath(input.object_dir(), ".javac-server");
+}
+
+const char kServerSource[] =
+    "// javac server for repobuild java_library (see javac_client.py).\n"
+    "//\n"
+    "//   java JavacServer.java <unix socket>\n"
+    "//\n"
+    "// Each request is \"<cwd>\\0<javac arg>\\0...\", compiled in-process\n"
+    "// by the system compiler. The reply is \"<exit code>\\n<output>\".\n"
+    "// Requests from another directory get exit code -1 (the client then\n"
+    "// compiles locally).\n"
+    "// Exits after an hour without requests.\n"
+    "import java.io.ByteArrayOutputStream;\n"
+    "import java.io.IOException;\n"
+    "import java.io.InputStream;\n"
+    "import java.io.OutputStream;\n"
+    "import java.net.StandardProtocolFamily;\n"
+    "import java.net.UnixDomainSocketAddress;\n"
+    "import java.nio.channels.Channels;\n"
+    "import java.nio.channels.ServerSocketChannel;\n"
+    "import java.nio.channels.SocketChannel;\n"
+    "import java.nio.charset.StandardCharsets;\n"
+    "import java.nio.file.Files;\n"
+    "import java.nio.file.Path;\n"
+    "import java.nio.file.Paths;\n"
+    "import java.util.Arrays;\n"
+    "import java.util.concurrent.ExecutorService;\n"
+    "import java.util.concurrent.Executors;\n"
+    "import java.util.concurrent.TimeUnit;\n"
+    "import javax.tools.JavaCompiler;\n"
+    "import javax.tools.ToolProvider;\n"
+    "\n"
+    "public class JavacServer {\n"
+    "  private static final long IDLE_MILLIS =\n"
+    "      TimeUnit.HOURS.toMillis(1);\n"
+    "  private static volatile long lastRequest =\n"
+    "      System.currentTimeMillis();\n"
+    "\n"
+    "  public static void main(String[] args) throws Exception {\n"
+    "    JavaCompiler javac = ToolProvider.getSystemJavaCompiler();\n"
+    "    if (javac == null) {\n"
+    "      System.err.println(\"No system java compiler (not a JDK?)\");\n"
+    "      System.exit(1);\n"
+    "    }\n"
+    "    String cwd = Paths.get(\"\").toAbsolutePath().toString();\n"
+    "    Path socket = Paths.get(args[0]);\n"
+    "    Files.deleteIfExists(socket);\n"
+    "    ServerSocketChannel server =\n"
+    "        ServerSocketChannel.open(StandardProtocolFamily.UNIX);\n"
+    "    server.bind(UnixDomainSocketAddress.of(socket));\n"
+    "\n"
+    "    Executors.newSingleThreadScheduledExecutor()\n"
+    "        .scheduleAtFixedRate(() -> {\n"
+    "      if (System.currentTimeMillis() - lastRequest > IDLE_MILLIS) {\n"
+    "        try {\n"
+    "          Files.deleteIfExists(socket);\n"
+    "        } catch (IOException e) {\n"
+    "          // exiting anyway.\n"
+    "        }\n"
+    "        System.exit(0);\n"
+    "      }\n"
+    "    }, 1, 1, TimeUnit.MINUTES);\n"
+    "\n"
+    "    ExecutorService pool = Executors.newCachedThreadPool();\n"
+    "    while (true) {\n"
+    "      SocketChannel client = server.accept();\n"
+    "      lastRequest = System.currentTimeMillis();\n"
+    "      pool.execute(() -> handle(javac, cwd, client));\n"
+    "    }\n"
+    "  }\n"
+    "\n"
+    "  private static void handle(JavaCompiler javac, String cwd,\n"
+    "                             SocketChannel client) {\n"
+    "    try (SocketChannel channel = client) {\n"
+    "      InputStream in = Channels.newInputStream(channel);\n"
+    "      String[] request =\n"
+    "          new String(in.readAllBytes(), StandardCharsets.UTF_8)\n"
+    "              .split(\"\\0\");\n"
+    "      ByteArrayOutputStream output = new ByteArrayOutputStream();\n"
+    "      int code = -1;\n"
+    "      if (request.length > 0 && request[0].equals(cwd)) {\n"
+    "        code = javac.run(\n"
+    "            null, output, output,\n"
+    "            Arrays.copyOfRange(request, 1, request.length));\n"
+    "      }\n"
+    "      OutputStream out = Channels.newOutputStream(channel);\n"
+    "      out.write((code + \"\\n\").getBytes(StandardCharsets.UTF_8));\n"
+    "      output.writeTo(out);\n"
+    "      out.flush();\n"
+    "    } catch (IOException e) {\n"
+    "      // The client falls back to a local javac.\n"
+    "    }\n"
+    "  }\n"
+    "}\n";
+
+const char kClientScript[] =
+    "#!/usr/bin/env python3\n"
+    "\"\"\"javac client for repobuild java_library (--java_compile_server).\n"
+    "\n"
+    "Usage: javac_client.py <JavacServer.java> <state dir> <args>...\n"
+    "\n"
+    "Compiles through a long-lived javac server (one JVM, warm JIT)\n"
+    "listening on <state dir>/javac.sock, starting it if needed. If the\n"
+    "server can not be used (e.g. no java >= 16), runs a local javac.\n"
+    "\"\"\"\n"
+    "\n"
+    "import fcntl\n"
+    "import os\n"
+    "import socket\n"
+    "import subprocess\n"
+    "import sys\n"
+    "import time\n"
+    "\n"
+    "START_TIMEOUT_SECS = 30\n"
+    "\n"
+    "\n"
+    "def Compile(sock_path, args):\n"
+    "  \"\"\"Returns (exit code, output), or None without a server.\"\"\"\n"
+    "  s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)\n"
+    "  try:\n"
+    "    s.connect(sock_path)\n"
+    "  except OSError:\n"
+    "    s.close()\n"
+    "    return None\n"
+    "  try:\n"
+    "    request = [os.getcwd()] + args\n"
+    "    s.sendall(b\"\\0\".join(a.encode() for a in request))\n"
+    "    s.shutdown(socket.SHUT_WR)\n"
+    "    reply = []\n"
+    "    while True:\n"
+    "      chunk = s.recv(1 << 16)\n"
+    "      if not chunk:\n"
+    "        break\n"
+    "      reply.append(chunk)\n"
+    "  except OSError:\n"
+    "    return None\n"
+    "  finally:\n"
+    "    s.close()\n"
+    "  code, _, output = b\"\".join(reply).partition(b\"\\n\")\n"
+    "  try:\n"
+    "    return int(code), output\n"
+    "  except ValueError:\n"
+    "    return None\n"
+    "\n"
+    "\n"
+    "def StartServer(server_java, state_dir, sock_path, args):\n"
+    "  \"\"\"Starts a server (once across parallel clients), compiles.\"\"\"\n"
+    "  failed = os.path.join(state_dir, \"failed\")\n"
+    "  with open(os.path.join(state_dir, \"lock\"), \"w\") as lock:\n"
+    "    fcntl.flock(lock, fcntl.LOCK_EX)\n"
+    "    result = Compile(sock_path, args)  # someone else started it.\n"
+    "    if result is not None or os.path.exists(failed):\n"
+    "      return result\n"
+    "    log = open(os.path.join(state_dir, \"server.log\"), \"ab\")\n"
+    "    server = subprocess.Popen(\n"
+    "        [os.environ.get(\"JAVA\", \"java\"), server_java, sock_path],\n"
+    "        stdin=subprocess.DEVNULL, stdout=log, stderr=log,\n"
+    "        start_new_session=True)\n"
+    "    deadline = time.time() + START_TIMEOUT_SECS\n"
+    "    while time.time() < deadline and server.poll() is None:\n"
+    "      result = Compile(sock_path, args)\n"
+    "      if result is not None:\n"
+    "        return result\n"
+    "      time.sleep(0.1)\n"
+    "    open(failed, \"w\").close()  # don't retry until \"make clean\".\n"
+    "    return None\n"
+    "\n"
+    "\n"
+    "def main(argv):\n"
+    "  server_java, state_dir, args = argv[1], argv[2], argv[3:]\n"
+    "  os.makedirs(state_dir, exist_ok=True)\n"
+    "  sock_path = os.path.join(state_dir, \"javac.sock\")\n"
+    "  result = None\n"
+    "  # -J (JVM flags) only work for a local javac.\n"
+    "  if not any(a.startswith(\"-J\") for a in args):\n"
+    "    result = Compile(sock_path, args)\n"
+    "    if result is None:\n"
+    "      try:\n"
+    "        result = StartServer(server_java, state_dir, sock_path,\n"
+    "                             args)\n"
+    "      except (OSError, subprocess.SubprocessError):\n"
+    "        result = None\n"
+    "  if result is None or result[0] < 0:\n"
+    "    javac = os.environ.get(\"JAVAC\", \"javac\")\n"
+    "    os.execvp(javac, [javac] + args)\n"
+    "  code, output = result\n"
+    "  sys.stderr.buffer.write(output)\n"
+    "  return code\n"
+    "\n"
+    "\n"
+    "if __name__ == \"__main__\":\n"
+    "  sys.exit(main(sys.argv))\n";
+}  // anonymous namespace
 
 JavaLibraryNode::JavaLibraryNode(const TargetInfo& t,
                                  const Input& i,
@@ -123,6 +329,10 @@ void JavaLibraryNode::WriteCompile(const ResourceFileSet& input_files,
       strings::JoinWith(" ",
                         strings::JoinAll(input_files.files(), " "),
                         strings::JoinAll(sources_, " ")));
+  if (input().java_compile_server()) {
+    rule->AddDependency(ClientScript(input()));
+    rule->AddDependency(ServerSource(input()));
+  }
 
   // Mkdir commands.
   for (const string d : directories) {
@@ -131,6 +341,12 @@ void JavaLibraryNode::WriteCompile(const ResourceFileSet& input_files,
 
   // Compile command.
   string compile = "javac";
+  if (input().java_compile_server()) {
+    compile = strings::JoinWith(" ",
+                                ClientScript(input()),
+                                ServerSource(input()),
+                                ServerStateDir(input()));
+  }
 
   // Collect class paths.
   set<string> java_classpath;
@@ -197,6 +413,45 @@ void JavaLibraryNode::WriteCompile(const ResourceFileSet& input_files,
   rule->WriteCommand("mkdir -p " + RootTouchfile().dirname());
   rule->WriteCommand("touch " + RootTouchfile().path());
   out->FinishRule(rule);
+
+  if (UseAbi()) {
+    WriteAbi(out);
+  }
+}
+
+void JavaLibraryNode::WriteAbi(Makefile* out) const {
+  // The javap rule runs whenever our classes change (tracked by a
+  // touchfile), but only replaces the api file if it differs. -package:
+  // dependents in our packages also see package private members. NB: javap
+  // without -v leaves out annotations and Signature attributes, so changes to
+  // either are missed (hence --java_abi_dependencies is off by default).
+  Resource abi = Abi();
+  Resource checked = Resource::FromRootPath(abi.path() + ".checked");
+  string tmp = abi.path() + ".tmp";
+  Makefile::Rule* rule =
+      out->StartRule(checked.path(), RootTouchfile().path());
+  rule->WriteCommand("(find " + ObjectRoot().path() + " -name '*.class' | "
+                     "LC_ALL=C sort | xargs -r javap -package -s -constants)"
+                     " > " + tmp);
+  rule->WriteCommand("cmp -s " + tmp + " " + abi.path() + " && rm -f " +
+                     tmp + " || mv -f " + tmp + " " + abi.path());
+  rule->WriteCommand("touch " + checked.path());
+  out->FinishRule(rule);
+
+  // Any recipe makes make re-stat the api file, so dependents only
+  // recompile if it actually changed.
+  rule = out->StartRule(abi.path(), checked.path());
+  rule->WriteCommand("true");
+  out->FinishRule(rule);
+}
+
+bool JavaLibraryNode::UseAbi() const {
+  return input().java_abi_dependencies() && !sources_.empty();
+}
+
+Resource JavaLibraryNode::Abi() const {
+  return Resource::FromLocalPath(input().object_dir(),
+                                 "lib_" + target().make_path() + ".api");
 }
 
 void JavaLibraryNode::LocalLinkFlags(LanguageType lang,
@@ -235,6 +490,11 @@ void JavaLibraryNode::LocalObjectRoots(LanguageType lang,
 
 void JavaLibraryNode::LocalDependencyFiles(LanguageType lang,
                                            ResourceFileSet* files) const {
+  if (lang == JAVA && UseAbi()) {
+    files->Add(Abi());  // which depends on our class files.
+    return;
+  }
+
   for (const Resource& r : sources_) {
     files->Add(r);
   }
@@ -266,6 +526,14 @@ Resource JavaLibraryNode::ObjectRoot() const {
                                  "lib_" + target().make_path());
 }
 
+// static
+void JavaLibraryNode::WriteMakeHead(const Input& input, Makefile* out) {
+  if (input.java_compile_server()) {
+    out->GenerateExecFile("JavacServer", ServerSource(input), kServerSource);
+    out->GenerateExecFile("JavacClient", ClientScript(input), kClientScript);
+  }
+}
+
 Resource JavaLibraryNode::RootTouchfile() const {
   return Resource::FromLocalPath(ObjectRoot().path(), ".dummy.touch");
 }
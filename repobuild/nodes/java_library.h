@@ -37,6 +37,9 @@ class JavaLibraryNode : public Node {
   virtual void LocalDependencyFiles(LanguageType lang,
                                     ResourceFileSet* files) const;
 
+  // Static preprocessors
+  static void WriteMakeHead(const Input& input, Makefile* out);
+
   // For direct construction.
   void Set(BuildFile* file,
            const BuildFileNode& input,
@@ -51,6 +54,13 @@ class JavaLibraryNode : public Node {
   Resource ObjectRoot() const;
   Resource RootTouchfile() const;
 
+  // API of our classes (--java_abi_dependencies), which only changes
+  // timestamp when the API does. Java dependents depend on it rather than
+  // on our classes, like headers vs objects for c++.
+  bool UseAbi() const;
+  Resource Abi() const;
+  void WriteAbi(Makefile* out) const;
+
   std::vector<Resource> sources_;
   std::vector<std::string> java_local_compile_args_;
   std::vector<std::string> java_compile_args_;
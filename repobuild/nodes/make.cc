@@ -8,6 +8,7 @@
 #include <vector>
 #include "common/log/log.h"
 #include "common/strings/path.h"
+#include "common/strings/strutil.h"
 #include "repobuild/env/input.h"
 #include "repobuild/env/resource.h"
 #include "repobuild/nodes/make.h"
@@ -76,9 +77,30 @@ void MakeNode::ParseWithOptions(BuildFile* file,
   GenShNode* gen = NewSubNodeWithCurrentDeps<GenShNode>(file);
   gen->SetCd(true);
   gen->SetMakeName("Make");
+  bool strict_inputs = false;
+  current_reader()->ParseBoolField("strict_inputs", &strict_inputs);
+  gen->SetStrictInputs(strict_inputs);
+
+  // jobs: by default the sub-make shares our jobserver (gen_sh passes it
+  // $(MAKE), see GenShNode::WriteCommand), so it gets whatever part of
+  // our -j is free and never oversubscribes it. "jobs": N overrides that
+  // rather than capping it: the sub-make runs -jN with a jobserver of its
+  // own, and adds up to N - 1 jobs on top of our -j (even with -j1).
+  // cmake nodes run their generated Makefiles with this $MAKE, not
+  // "cmake --build", so the same applies; CMAKE_BUILD_PARALLEL_LEVEL is
+  // only for sub-builds that call "cmake --build" themselves.
+  int jobs = 0;
+  current_reader()->ParseIntField("jobs", &jobs);
+  string make_bin = "$MAKE";
+  if (jobs > 0) {
+    make_bin = strings::StringPrintf(
+        "CMAKE_BUILD_PARALLEL_LEVEL=%d $MAKE -j%d", jobs, jobs);
+  } else if (jobs < 0) {
+    LOG(FATAL) << "\"jobs\" must be positive: " << target().full_path();
+  }
 
-  string make_cmd = ("$MAKE " + make_args_str + " -f " + make_file + " "
-                     + make_target);
+  string make_cmd = (make_bin + " " + make_args_str + " -f " + make_file +
+                     " " + make_target);
   if (!preinstall.empty()) {
     make_cmd = preinstall + " && " + make_cmd;
   }
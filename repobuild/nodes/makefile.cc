@@ -3,12 +3,14 @@
 
 #include <string>
 #include <set>
+#include <vector>
 #include "common/strings/path.h"
 #include "common/strings/strutil.h"
 #include "repobuild/nodes/makefile.h"
 
 using std::set;
 using std::string;
+using std::vector;
 
 namespace repobuild {
 namespace {
@@ -133,6 +135,27 @@ void Makefile::GenerateExecFile(const string& name,
   FinishRule(rule);
 }
 
+void Makefile::GenerateFileIfChanged(const string& file_path,
+                                     const vector<string>& lines) {
+  // Several printf commands, as a single (sh -c) argument is limited in
+  // size.
+  const int kLinesPerCommand = 256;
+  string tmp = file_path + ".tmp";
+  Rule* rule = StartRule(file_path, "$(firstword $(MAKEFILE_LIST))");
+  rule->WriteCommand("mkdir -p " + strings::PathDirname(file_path));
+  rule->WriteCommand("rm -f " + tmp + " && touch " + tmp);
+  for (int i = 0; i < lines.size(); i += kLinesPerCommand) {
+    string command = "printf '%s\\n'";
+    for (int j = i; j < lines.size() && j < i + kLinesPerCommand; ++j) {
+      command += " '" + strings::ReplaceAll(lines[j], "'", "'\\''") + "'";
+    }
+    rule->WriteCommand(command + " >> " + tmp);
+  }
+  rule->WriteCommand("cmp -s " + tmp + " " + file_path + " && rm -f " + tmp +
+                     " || mv -f " + tmp + " " + file_path);
+  FinishRule(rule);
+}
+
 void Makefile::FinishMakefile() {
   Rule* rule = StartRawRule(GetPrereqFile(),
                             strings::JoinAll(prereq_rules_, " "));
@@ -6,6 +6,7 @@
 
 #include <set>
 #include <string>
+#include <vector>
 #include "common/strings/strutil.h"
 
 namespace repobuild {
@@ -94,6 +95,10 @@ class Makefile {
   void GenerateExecFile(const std::string& name,
                         const std::string& file_path,
                         const std::string& value);
+  // Writes "lines" (make variables are expanded) to "file_path" whenever
+  // the makefile changes, but only touches it if the contents differ.
+  void GenerateFileIfChanged(const std::string& file_path,
+                             const std::vector<std::string>& lines);
 
   static std::string Escape(const std::string& input);
 
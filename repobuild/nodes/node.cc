@@ -16,7 +16,7 @@
 #include "repobuild/nodes/node.h"
 #include "repobuild/nodes/util.h"
 #include "repobuild/reader/buildfile.h"
-#include "repobuild/third_party/json/json.h"
+#include "repobuild/reader/buildfile_reader.h"
 
 using std::map;
 using std::string;
@@ -58,12 +58,7 @@ Node::~Node() {
 }
 
 void Node::Parse(BuildFile* file, const BuildFileNode& input) {
-  // Set up build reader.
-  CHECK(input.object().isObject())
-      << "Expected object for node " << target().full_path();
-  build_reader_.reset(NewBuildReader(input));
-  current_reader()->ParseBoolField("strict_file_mode", &strict_file_mode_);
-  build_reader_->SetStrictFileMode(strict_file_mode_);
+  InitBuildReader(input);
 
   // Figure out our dependencies.
   vector<string> deps;
@@ -79,6 +74,14 @@ void Node::Parse(BuildFile* file, const BuildFileNode& input) {
   current_reader()->ParseRepeatedString("licenses", &licenses_);
 }
 
+void Node::InitBuildReader(const BuildFileNode& input) {
+  CHECK(input.object().is_object())
+      << "Expected object for node " << target().full_path();
+  build_reader_.reset(NewBuildReader(input));
+  current_reader()->ParseBoolField("strict_file_mode", &strict_file_mode_);
+  build_reader_->SetStrictFileMode(strict_file_mode_);
+}
+
 void Node::PostParse() {
   InitComponentHelpers();
 }
@@ -206,6 +209,15 @@ void Node::LocalEnvVariables(LanguageType lang,
   }
 }
 
+void Node::InputCxxModules(LanguageType lang,
+                           map<string, Resource>* modules) const {
+  vector<Node*> all_deps;
+  CollectAllDependencies(CXX_MODULES, lang, &all_deps);
+  for (Node* node : all_deps) {
+    node->LocalCxxModules(lang, modules);
+  }
+}
+
 void Node::InputDependencyFiles(LanguageType lang,
                                 ResourceFileSet* files) const {
   vector<Node*> all_deps;
@@ -216,6 +228,25 @@ void Node::InputDependencyFiles(LanguageType lang,
   }
 }
 
+void Node::DirectDependencyFiles(LanguageType lang,
+                                 ResourceFileSet* files) const {
+  for (Node* node : dependencies_) {
+    if (IncludeChildDependency(DEPENDENCY_FILES, lang, node) &&
+        node->ShouldInclude(DEPENDENCY_FILES, lang)) {
+      ResourceFileSet node_files;
+      node->LocalDependencyFiles(lang, &node_files);
+      node->LocalBinaries(lang, &node_files);
+      if (node_files.files().empty()) {
+        // A forwarding node (e.g. config, or only "dependencies"): use
+        // what it stands for.
+        node->DirectDependencyFiles(lang, files);
+      } else {
+        files->AddRange(node_files);
+      }
+    }
+  }
+}
+
 void Node::InputObjectFiles(LanguageType lang, ResourceFileSet* files) const {
   vector<Node*> all_deps;
   CollectAllDependencies(OBJECT_FILES, lang, &all_deps);
@@ -224,6 +255,18 @@ void Node::InputObjectFiles(LanguageType lang, ResourceFileSet* files) const {
   }
 }
 
+void Node::WriteMakeVariant(LanguageType lang,
+                            const ObjectVariant& variant,
+                            ResourceFileSet* objects,
+                            Makefile* out) const {
+  vector<Node*> all_deps;
+  CollectAllDependencies(OBJECT_FILES, lang, &all_deps);
+  for (Node* node : all_deps) {
+    node->LocalWriteMakeVariant(lang, variant, objects, out);
+  }
+  LocalWriteMakeVariant(lang, variant, objects, out);
+}
+
 void Node::InputObjectRoots(LanguageType lang, ResourceFileSet* dirs) const {
   vector<Node*> all_deps;
   CollectAllDependencies(OBJECT_FILES, lang, &all_deps);
@@ -302,11 +345,24 @@ void Node::Licenses(std::set<std::string>* licenses) const {
   }
 }
 
+void Node::SourceGlobs(std::set<std::string>* globs) const {
+  if (build_reader_.get() != NULL) {
+    globs->insert(build_reader_->file_globs().begin(),
+                  build_reader_->file_globs().end());
+  }
+}
+
 void Node::EnvVariables(LanguageType lang, map<string, string>* env) const {
   InputEnvVariables(lang, env);
   LocalEnvVariables(lang, env);
 }
 
+void Node::CxxModules(LanguageType lang,
+                      map<string, Resource>* modules) const {
+  InputCxxModules(lang, modules);
+  LocalCxxModules(lang, modules);
+}
+
 void Node::DependencyFiles(LanguageType lang, ResourceFileSet* files) const {
   InputDependencyFiles(lang, files);
   LocalDependencyFiles(lang, files);
@@ -346,6 +402,10 @@ void Node::TopTestBinaries(LanguageType lang, ResourceFileSet* outputs) const {
   LocalBinaries(lang, outputs);  // no input binaries, just top level.
 }
 
+void Node::TopTests(LanguageType lang, set<string>* targets) const {
+  LocalTests(lang, targets);  // no input tests, just top level.
+}
+
 void Node::LinkFlags(LanguageType lang, set<string>* flags) const {
   InputLinkFlags(lang, flags);
   LocalLinkFlags(lang, flags);
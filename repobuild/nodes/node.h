@@ -58,14 +58,48 @@ class Node {
   void FinalTests(LanguageType lang, std::set<std::string>* targets) const;
   void Binaries(LanguageType lang, ResourceFileSet* outputs) const;
   void TopTestBinaries(LanguageType lang, ResourceFileSet* outputs) const;
+  void TopTests(LanguageType lang, std::set<std::string>* targets) const;
   void SystemDependencies(LanguageType lang, std::set<std::string>* deps) const;
   void Licenses(std::set<std::string>* licenses) const;
+  void SourceGlobs(std::set<std::string>* globs) const;
   virtual void ExternalDependencyFiles(
       LanguageType lang,
       std::map<std::string, std::string>* files) const {}
   virtual bool IncludeInAll() const { return true; }
   virtual bool IncludeInTests() const { return false; }
 
+  // Tests we can execute directly, rather than through make (see
+  // generator/test_runner.h). Paths are relative to the root dir.
+  struct TestSpec {
+    TestSpec() : timeout_secs(0), shard_count(1) {}
+    std::string name;  // make target.
+    std::string binary, dir, gen_dir, obj_dir, src_dir;
+    std::vector<std::string> data;  // runtime inputs, besides binary.
+    std::map<std::string, std::string> env;
+    int timeout_secs;  // 0 == runner default.
+    int shard_count;
+  };
+  virtual void TestSpecs(std::vector<TestSpec>* specs) const {}
+
+  // Object file variants: our ObjectFiles() compiled again into another
+  // object dir with extra flags (e.g. PGO builds, see cc_binary). Writes
+  // the compile rules and collects the variant objects, in link order.
+  struct ObjectVariant {
+    ObjectVariant() : ephemeral_only(false) {}
+    std::string object_dir;
+    std::string compile_flags;
+    std::string dependencies;  // extra prerequisites of each object.
+
+    // Ephemeral sources (recompiled whenever their consumer relinks), see
+    // cc_binary. If "ephemeral_only" is set, nothing else is recompiled.
+    bool ephemeral_only;
+    std::string ephemeral_dependencies;
+  };
+  void WriteMakeVariant(LanguageType lang,
+                        const ObjectVariant& variant,
+                        ResourceFileSet* objects,
+                        Makefile* out) const;
+
   // Flag inheritence
   void LinkFlags(LanguageType lang,
                  std::set<std::string>* flags) const;
@@ -75,6 +109,9 @@ class Node {
                    std::set<std::string>* dirs) const;
   void EnvVariables(LanguageType lang,
                     std::map<std::string, std::string>* vars) const;
+  // C++ modules: module (or header unit) name -> BMI file.
+  void CxxModules(LanguageType lang,
+                  std::map<std::string, Resource>* modules) const;
 
   // Accessors.
   const Input& input() const { return *input_; }
@@ -122,6 +159,13 @@ class Node {
   virtual void LocalObjectFiles(
       LanguageType lang,
       ResourceFileSet* files) const {}
+  virtual void LocalWriteMakeVariant(
+      LanguageType lang,
+      const ObjectVariant& variant,
+      ResourceFileSet* objects,
+      Makefile* out) const {
+    LocalObjectFiles(lang, objects);  // default: objects are unchanged.
+  }
   virtual void LocalObjectRoots(
       LanguageType lang,
       ResourceFileSet* dirs) const {}
@@ -149,6 +193,9 @@ class Node {
   virtual void LocalEnvVariables(
       LanguageType lang, 
       std::map<std::string, std::string>* vars) const;
+  virtual void LocalCxxModules(
+      LanguageType lang,
+      std::map<std::string, Resource>* modules) const {}
   virtual bool PathRewrite(std::string* output_path,
                            std::string* rewrite_root) const {
     return false;
@@ -157,6 +204,9 @@ class Node {
   // Parsing helpers
   BuildFileNodeReader* NewBuildReader(const BuildFileNode& node) const;
   BuildFileNodeReader* current_reader() const { return build_reader_.get(); }
+  // Sets up current_reader() (done by Parse), for nodes that override Parse
+  // but still read fields whose globs should show up in SourceGlobs.
+  void InitBuildReader(const BuildFileNode& input);
 
   // Directory helpers.
   std::string GenDir() const { return gen_dir_; }
@@ -185,6 +235,9 @@ class Node {
 
   // Dependency helpers
   void InputDependencyFiles(LanguageType lang, ResourceFileSet* files) const;
+  // Just the dependency files/binaries of our direct dependencies, looking
+  // through dependencies that have none of their own.
+  void DirectDependencyFiles(LanguageType lang, ResourceFileSet* files) const;
   void InputObjectFiles(LanguageType lang, ResourceFileSet* files) const;
   void InputObjectRoots(LanguageType lang, ResourceFileSet* dirs) const;
   void InputSystemDependencies(LanguageType lang,
@@ -197,6 +250,8 @@ class Node {
   void InputIncludeDirs(LanguageType lang, std::set<std::string>* dirs) const;
   void InputEnvVariables(LanguageType lang,
                          std::map<std::string, std::string>* vars) const;
+  void InputCxxModules(LanguageType lang,
+                       std::map<std::string, Resource>* modules) const;
   void InitComponentHelpers();
   const ComponentHelper* GetComponentHelper(const std::string& path) const;
   const ComponentHelper* GetComponentHelper(const ComponentHelper* preferred,
@@ -212,7 +267,8 @@ class Node {
     LINK_FLAGS,
     COMPILE_FLAGS,
     INCLUDE_DIRS,
-    ENV_VARIABLES
+    ENV_VARIABLES,
+    CXX_MODULES
   };
   void CollectAllDependencies(DependencyCollectionType type,
                               LanguageType lang,
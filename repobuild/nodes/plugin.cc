@@ -7,6 +7,8 @@
 #include "common/log/log.h"
 #include "common/util/shell.h"
 #include "repobuild/nodes/plugin.h"
+#include "repobuild/reader/buildfile.h"
+#include "repobuild/reader/buildfile_reader.h"
 #include "repobuild/third_party/json/json.h"
 
 using std::string;
@@ -31,9 +33,11 @@ bool PluginNode::ExpandBuildFileNode(BuildFile* file, BuildFileNode* node) {
   }
 
   // Execute subprocess.
+  Json::Value input;
+  node->object().ToJson(&input);
   string stdout;
   Json::FastWriter writer;
-  int status = util::Execute(writer.write(node->object()),
+  int status = util::Execute(writer.write(input),
                              command_.c_str(),
                              &stdout);
   if (status != 0) {
@@ -57,7 +61,7 @@ bool PluginNode::ExpandBuildFileNode(BuildFile* file, BuildFileNode* node) {
                << stdout;
   }
   CHECK(root.isObject()) << root;
-  if (root != node->object()) {
+  if (root != input) {
     node->Reset(root);
     return true;
   }
@@ -5,6 +5,9 @@
 #include <string>
 #include <vector>
 #include <iterator>
+#include "common/log/log.h"
+#include "common/strings/path.h"
+#include "common/strings/strutil.h"
 #include "repobuild/env/input.h"
 #include "repobuild/env/resource.h"
 #include "repobuild/nodes/py_binary.h"
@@ -29,6 +32,13 @@ void PyBinaryNode::Parse(BuildFile* file, const BuildFileNode& input) {
 }
 
 void PyBinaryNode::LocalWriteMake(Makefile* out) const {
+  if (UseZipapp()) {
+    PyLibraryNode::LocalWriteMakeInternal(false, out);
+    WriteZipapp(out);
+    WriteBaseUserTarget(out);
+    return;
+  }
+
   PyEggNode::LocalWriteMakeInternal(false, out);
 
   // "Binary"
@@ -54,10 +64,64 @@ void PyBinaryNode::LocalWriteMake(Makefile* out) const {
   WriteBaseUserTarget(out);
 }
 
+// The zip has no equivalent of plink's -L, and needs a module to run.
+bool PyBinaryNode::UseZipapp() const {
+  return (input().py_zipapp() &&
+          !py_default_module_.empty() &&
+          sys_deps_.empty());
+}
+
+void PyBinaryNode::WriteZipapp(Makefile* out) const {
+  // Every module with its bytecode, plus the __init__.py of each parent
+  // package (FinishMakeFile in py_library writes those).
+  ResourceFileSet sources, deps;
+  ObjectFiles(PYTHON, &sources);
+  set<string> entries, packages;
+  const string pkg_dir = input().pkgfile_dir();
+  for (const Resource& source : sources.files()) {
+    vector<Resource> files(1, source);
+    for (string dir = source.dirname();
+         strings::HasPrefix(dir, pkg_dir + "/") &&
+             packages.insert(dir).second;
+         dir = strings::PathDirname(dir)) {
+      files.push_back(Resource::FromLocalPath(dir, "__init__.py"));
+    }
+    for (const Resource& file : files) {
+      string name = StripSpecialDirs(file.path());
+      entries.insert(name + "=" + file.path());
+      deps.Add(file);
+      if (strings::HasSuffix(name, ".py") &&
+          strings::HasPrefix(file.path(), pkg_dir + "/")) {
+        Resource pyc = PycFileFor(input(), file);
+        entries.insert(name + "c=" + pyc.path());
+        deps.Add(pyc);
+      }
+    }
+  }
+
+  Resource bin = BinScript();
+  Makefile::Rule* rule = out->StartRule(
+      bin.path(),
+      strings::JoinWith(" ",
+                        ZipTool(input()),
+                        strings::JoinAll(deps.files(), " ")));
+  rule->WriteUserEcho("Packaging", bin.path());
+  rule->WriteCommand("mkdir -p " + bin.dirname());
+  rule->WriteCommand(strings::JoinWith(
+      " ",
+      "python3", ZipTool(input()), "zipapp",
+      bin.path(),
+      py_default_module_,
+      strings::JoinAll(entries, " ")));
+  out->FinishRule(rule);
+}
+
 void PyBinaryNode::LocalBinaries(LanguageType lang,
                                  ResourceFileSet* outputs) const {
   outputs->Add(BinScript());
-  outputs->Add(OutEgg());
+  if (!UseZipapp()) {
+    outputs->Add(OutEgg());
+  }
 }
 
 Resource PyBinaryNode::BinScript() const {
@@ -28,6 +28,8 @@ class PyBinaryNode : public PyEggNode {
 
  protected:
   Resource BinScript() const;
+  bool UseZipapp() const;
+  void WriteZipapp(Makefile* out) const;
 };
 
 }  // namespace repobuild
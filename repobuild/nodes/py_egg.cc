@@ -151,6 +151,7 @@ void PyEggNode::GetSources(ResourceFileSet* deps,
 
 // static
 void PyEggNode::WriteMakeHead(const Input& input, Makefile* out) {
+  PyLibraryNode::WriteMakeHead(input, out);
   const char kPyScript[] =
       "import os\n"
       "from setuptools import setup\n"
@@ -67,11 +67,20 @@ void PyLibraryNode::LocalWriteMakeInternal(bool write_user_target,
     }
   }
 
+  // Bytecode, one rule per module so that make compiles only what
+  // changed, in parallel. __init__.py files are compiled by
+  // FinishMakeFile, which also creates the missing ones.
+  ResourceFileSet bytecode;
+  for (const Resource& symlink : symlinked_sources) {
+    if (symlink.basename() != "__init__.py") {
+      WriteBytecode(input(), symlink, out);
+    }
+    bytecode.Add(PycFileFor(input(), symlink));
+  }
+
   // Syntax check.
-  string sources = strings::JoinAll(symlinked_sources, " ");
-  Makefile::Rule* rule = out->StartRule(touchfile_.path(), sources);
-  rule->WriteUserEcho("Compiling", target().full_path() + " (python)");
-  rule->WriteCommand("python -m py_compile " + sources);
+  Makefile::Rule* rule = out->StartRule(
+      touchfile_.path(), strings::JoinAll(bytecode.files(), " "));
   rule->WriteCommand("mkdir -p " + Touchfile().dirname());
   rule->WriteCommand("touch " + Touchfile().path());
   out->FinishRule(rule);
@@ -120,6 +129,85 @@ void PyLibraryNode::Init() {
 }
 
 namespace {
+const char kPyZip[] =
+    "#!/usr/bin/env python3\n"
+    "\"\"\"Python packaging helper for repobuild py_library/py_binary.\n"
+    "\n"
+    "  pyzip.py compile <source.py> <out.pyc> <name in archive>\n"
+    "  pyzip.py zipapp <out> <main module> <name in archive>=<file>...\n"
+    "\n"
+    "compile writes bytecode for one module; make runs these in parallel\n"
+    "and only for changed sources. The .pyc is hash based (python >= 3.7)\n"
+    "and never checked against a source, so it is reproducible.\n"
+    "\n"
+    "zipapp writes an executable archive: a #! line, then a zip with\n"
+    "__main__.py first and every other entry sorted, all with fixed\n"
+    "timestamps. Bytecode is stored uncompressed so imports need no\n"
+    "inflate; sources are only read for tracebacks and are deflated.\n"
+    "\"\"\"\n"
+    "\n"
+    "import os\n"
+    "import py_compile\n"
+    "import sys\n"
+    "import zipfile\n"
+    "\n"
+    "TIMESTAMP = (2010, 1, 1, 0, 0, 0)\n"
+    "MAIN = \"\"\"import runpy\n"
+    "runpy.run_module(%r, run_name=\"__main__\", alter_sys=True)\n"
+    "\"\"\"\n"
+    "\n"
+    "\n"
+    "def Compile(source, pyc, name):\n"
+    "  kwargs = {}\n"
+    "  mode = getattr(py_compile, \"PycInvalidationMode\", None)\n"
+    "  if mode is not None:\n"
+    "    kwargs[\"invalidation_mode\"] = mode.UNCHECKED_HASH\n"
+    "  try:\n"
+    "    py_compile.compile(source, cfile=pyc, dfile=name, doraise=True,\n"
+    "                       **kwargs)\n"
+    "  except py_compile.PyCompileError as e:\n"
+    "    sys.stderr.write(e.msg + \"\\n\")\n"
+    "    return 1\n"
+    "  return 0\n"
+    "\n"
+    "\n"
+    "def Add(archive, name, data):\n"
+    "  info = zipfile.ZipInfo(name, TIMESTAMP)\n"
+    "  info.external_attr = 0o644 << 16\n"
+    "  if name.endswith(\".pyc\"):\n"
+    "    info.compress_type = zipfile.ZIP_STORED\n"
+    "  else:\n"
+    "    info.compress_type = zipfile.ZIP_DEFLATED\n"
+    "  archive.writestr(info, data)\n"
+    "\n"
+    "\n"
+    "def Zipapp(out, module, files):\n"
+    "  entries = dict(f.split(\"=\", 1) for f in files)\n"
+    "  tmp = out + \".tmp\"\n"
+    "  with open(tmp, \"wb\") as f:\n"
+    "    f.write(b\"#!/usr/bin/env python3\\n\")\n"
+    "    with zipfile.ZipFile(f, \"w\") as archive:\n"
+    "      Add(archive, \"__main__.py\", MAIN % module)\n"
+    "      for name in sorted(entries):\n"
+    "        with open(entries[name], \"rb\") as data:\n"
+    "          Add(archive, name, data.read())\n"
+    "  os.chmod(tmp, 0o755)\n"
+    "  os.rename(tmp, out)\n"
+    "  return 0\n"
+    "\n"
+    "\n"
+    "def main(argv):\n"
+    "  if len(argv) == 5 and argv[1] == \"compile\":\n"
+    "    return Compile(argv[2], argv[3], argv[4])\n"
+    "  if len(argv) >= 4 and argv[1] == \"zipapp\":\n"
+    "    return Zipapp(argv[2], argv[3], argv[4:])\n"
+    "  sys.stderr.write(__doc__)\n"
+    "  return 2\n"
+    "\n"
+    "\n"
+    "if __name__ == \"__main__\":\n"
+    "  sys.exit(main(sys.argv))\n";
+
 bool IsBetterInitPy(const string& original, const string& replacement) {
   // TODO(cvanarsdale): __init__.py preference if multiple __init__.py
   // files map to the same location? This is a bit hacky.
@@ -233,9 +321,48 @@ void PyLibraryNode::FinishMakeFile(const Input& input,
           init_py,
           parent);
     }
+    if (!out->seen_rule(PycFileFor(input, pkg_init_py).path())) {
+      WriteBytecode(input, pkg_init_py, out);
+    }
   }
 }
 
+// static
+void PyLibraryNode::WriteMakeHead(const Input& input, Makefile* out) {
+  out->GenerateExecFile("PyZip", ZipTool(input), kPyZip);
+}
+
+// static
+void PyLibraryNode::WriteBytecode(const Input& input,
+                                  const Resource& py_file,
+                                  Makefile* out) {
+  Resource pyc = PycFileFor(input, py_file);
+  Makefile::Rule* rule = out->StartRule(
+      pyc.path(), strings::JoinWith(" ", py_file.path(), ZipTool(input)));
+  rule->WriteUserEcho("Compiling", py_file.path() + " (python)");
+  rule->WriteCommand("mkdir -p " + pyc.dirname());
+  rule->WriteCommand(strings::JoinWith(
+      " ",
+      "python3", ZipTool(input), "compile",
+      py_file.path(),
+      pyc.path(),
+      NodeUtil::StripSpecialDirs(input, py_file.path())));
+  out->FinishRule(rule);
+}
+
+// static
+Resource PyLibraryNode::PycFileFor(const Input& input,
+                                   const Resource& py_file) {
+  return Resource::FromLocalPath(
+      strings::JoinPath(input.object_dir(), "pyc"),
+      NodeUtil::StripSpecialDirs(input, py_file.path()) + "c");
+}
+
+// static
+string PyLibraryNode::ZipTool(const Input& input) {
+  return strings::JoinPath(input.genfile_dir(), "python/pyzip.py");
+}
+
 Resource PyLibraryNode::PyFileFor(const Resource& r) const {
   const ComponentHelper* helper = GetComponentHelper(component_.get(),
                                                      r.path());
@@ -36,6 +36,12 @@ class PyLibraryNode : public Node {
                              const std::vector<const Node*>& all_nodes,
                              DistSource* source,
                              Makefile* out);
+  static void WriteMakeHead(const Input& input, Makefile* out);
+
+  // Bytecode for a python file under the package dir, and the helper
+  // that compiles it and builds zipapps (see py_binary).
+  static Resource PycFileFor(const Input& input, const Resource& py_file);
+  static std::string ZipTool(const Input& input);
 
   // For manual construction.
   void Set(const std::vector<Resource>& sources);
@@ -45,6 +51,9 @@ class PyLibraryNode : public Node {
   void LocalWriteMakeInternal(bool write_user_target,
                               Makefile* out) const;
   Resource PyFileFor(const Resource& r) const;
+  static void WriteBytecode(const Input& input,
+                            const Resource& py_file,
+                            Makefile* out);
 
   Resource touchfile_;
   std::string py_base_dir_;
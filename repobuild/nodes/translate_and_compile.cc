@@ -6,6 +6,7 @@
 #include <set>
 #include <iterator>
 #include <vector>
+#include "common/base/flags.h"
 #include "common/log/log.h"
 #include "common/strings/path.h"
 #include "common/strings/strutil.h"
@@ -18,6 +19,12 @@
 #include "repobuild/nodes/py_library.h"
 #include "repobuild/reader/buildfile.h"
 
+DEFINE_bool(translate_batch, false,
+            "If true, translate_and_compile targets behave as if they had "
+            "\"batch\": true: all targets with the same translator command "
+            "(translator, arguments, environment) run it once, on all of "
+            "their sources.");
+
 using std::vector;
 using std::string;
 using std::set;
@@ -57,6 +64,9 @@ void TranslateAndCompileNode::Parse(BuildFile* file,
   gen_node_ = NewSubNodeWithCurrentDeps<GenShNode>(file);
   gen_node_->SetCd(false);
   gen_node_->SetMakeName(translator_);
+  bool strict_inputs = false;
+  current_reader()->ParseBoolField("strict_inputs", &strict_inputs);
+  gen_node_->SetStrictInputs(strict_inputs);
 
   string translator_binary = "$" + string(kTranslatorVar);
 
@@ -128,6 +138,17 @@ void TranslateAndCompileNode::Parse(BuildFile* file,
   current_reader()->ParseRepeatedString("translator_args", &translator_args);
   build_cmd += " " + strings::JoinAll(translator_args, " ");
 
+  // Targets that run the same translator command can share one run.
+  bool batch = FLAGS_translate_batch;
+  current_reader()->ParseBoolField("batch", &batch);
+  if (batch) {
+    vector<string> batch_args;
+    for (const Resource& r : input_files) {
+      batch_args.push_back(r.path());
+    }
+    gen_node_->SetBatch(build_cmd, batch_args);
+  }
+
   build_cmd += " " + strings::JoinAll(input_files, " ");
 
   gen_node_->Set(build_cmd, "", input_files, outputs);
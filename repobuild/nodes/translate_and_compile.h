@@ -32,6 +32,7 @@ class PyLibraryNode;
      "name": "simple_proto",
      "sources": [ "simple.proto" ],
      "translator": "protoc",
+     "batch": true,  // optional, share protoc runs, see gen_sh SetBatch.
      "generate_cc": true,
      "java_classnames": [ "..." ],
      "cc": {
@@ -7,6 +7,7 @@
 #include "common/strings/strutil.h"
 #include "repobuild/env/input.h"
 #include "repobuild/env/target.h"
+#include "repobuild/nodes/makefile.h"
 #include "repobuild/nodes/util.h"
 
 using std::string;
@@ -46,6 +47,35 @@ bool NodeUtil::StartsWithSpecialDirs(const Input& input, const string& path) {
           strings::HasPrefix(path, input.pkgfile_dir()));
 }
 
+// static
+string NodeUtil::CachedConfigureCommand(const string& key_words,
+                                        const string& package_dirs,
+                                        const string& package_files,
+                                        const string& configured_file,
+                                        const string& cache_file,
+                                        const string& configure_cmd,
+                                        bool make_escape) {
+  // NB: This ends up in gen_sh's eval '...', so no single quotes.
+  auto ours = [make_escape](const string& str) {
+    return make_escape ? Makefile::Escape(str) : str;
+  };
+  return ours("CDIR=$GEN_DIR/.configure; "
+              "KEY=$( (printf \"%s\\n\" $CC $CXX ") + key_words +
+      ours("; $CC --version; $CXX --version; "
+           "find ") + package_dirs + ours(" -type f \\( ") + package_files +
+      ours(" \\) -print0 | LC_ALL=C sort -z | xargs -0 cat) 2>&1 | "
+           "cksum | sed \"s/ /_/\"); "
+           "if [ -f ") + configured_file +
+      ours(" ] && [ \"$(cat $CDIR/key 2>/dev/null)\" = \"$KEY\" ]; then "
+           "echo \"configure: unchanged ($KEY)\"; "
+           "else rm -f $CDIR/key; "
+           "if [ -f $CDIR/$KEY/cache ]; then cp $CDIR/$KEY/cache ") +
+      cache_file + ours("; fi; (") + configure_cmd +
+      ours(") && { mkdir -p $CDIR/$KEY; cp ") + cache_file +
+      ours(" $CDIR/$KEY/cache 2>/dev/null; echo \"$KEY\" > $CDIR/key; }; "
+           "fi");
+}
+
 ComponentHelper::ComponentHelper(const std::string& component,
                                  const std::string& base_dir)
     : component_(component),
@@ -16,6 +16,21 @@ class NodeUtil {
                                       const std::string& path);
   static bool StartsWithSpecialDirs(const Input& input,
                                     const std::string& path);
+
+  // Shell command (for a gen_sh) that runs "configure_cmd" only if its
+  // inputs changed since the last successful run: "key_words" (flags,
+  // arguments), $CC/$CXX --version and every file under "package_dirs"
+  // matching the find expression "package_files". The cache file
+  // (config.cache, CMakeCache.txt) is snapshotted per key under
+  // $GEN_DIR/.configure, and restored when a key comes back. Only our
+  // own text is escaped for make if "make_escape" is set.
+  static std::string CachedConfigureCommand(const std::string& key_words,
+                                            const std::string& package_dirs,
+                                            const std::string& package_files,
+                                            const std::string& configured_file,
+                                            const std::string& cache_file,
+                                            const std::string& configure_cmd,
+                                            bool make_escape);
 };
 
 class ComponentHelper {
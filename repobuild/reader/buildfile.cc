@@ -1,6 +1,7 @@
 // Copyright 2013
 // Author: Christopher Van Arsdale
 
+#include <limits>
 #include <map>
 #include <set>
 #include <string>
@@ -14,6 +15,7 @@
 #include "repobuild/distsource/dist_source.h"
 #include "repobuild/env/resource.h"
 #include "repobuild/reader/buildfile.h"
+#include "repobuild/reader/buildfile_reader.h"
 #include "repobuild/third_party/json/json.h"
 
 using std::set;
@@ -23,27 +25,55 @@ using std::map;
 
 namespace repobuild {
 namespace {
-const Json::Value& GetValue(const BuildFileNode& input, const string& key) {
-  const Json::Value* current = &input.object();
-  for (const string& subkey : strings::SplitString(key, ".")) {
-    if (current->isNull()) {
-      break;
+// Returns the value of "key", where "a.b" is member "b" of object "a". This
+// runs for every field of every node, so the key is split in place and each
+// part is a binary search of the (sorted) members.
+const BuildValue& GetValue(const BuildFileNode& input, const string& key) {
+  const BuildValue* current = &input.object();
+  StringPiece rest(key);
+  size_t dot;
+  while ((dot = rest.find('.')) != StringPiece::npos) {
+    current = &current->Get(rest.substr(0, dot));
+    if (current->is_null()) {
+      return *current;
     }
-    current = &(*current)[subkey];
+    rest.remove_prefix(dot + 1);
   }
-  return *current;
+  return current->Get(rest);
+}
+
+void DieOnReaderError(const string& filename, const string& error) {
+  LOG(FATAL) << "BUILD file reader error\n\nIn "
+             << filename
+             << ":\n "
+             << error
+             << "\n\n(check for missing/spurious commas).\n\n";
 }
 }  // anonymous namespace
 
+BuildFileNode::BuildFileNode()
+    : document_(new BuildDocument),
+      object_(&document_->root()) {
+}
+
 BuildFileNode::BuildFileNode(const Json::Value& object) {
   Reset(object);
 }
 
+BuildFileNode::BuildFileNode(const BuildValue* object,
+                             std::shared_ptr<const BuildDocument> document)
+    : document_(document),
+      object_(object) {
+}
+
 BuildFileNode::~BuildFileNode() {
 }
 
 void BuildFileNode::Reset(const Json::Value& object) {
-  object_.reset(new Json::Value(object));
+  BuildDocument* document = new BuildDocument;
+  document->CopyFrom(object);
+  document_.reset(document);
+  object_ = &document->root();
 }
 
 BuildFile::~BuildFile() {
@@ -52,23 +82,60 @@ BuildFile::~BuildFile() {
 }
 
 void BuildFile::Parse(const string& input) {
-  Json::Value root;
-  Json::Reader reader;
-  bool ok = reader.parse(input, root);
-  if (!ok) {
-    LOG(FATAL) << "BUILD file reader error\n\nIn "
-               << filename()
-               << ":\n "
-               << reader.getFormattedErrorMessages()
-               << "\n\n(check for missing/spurious commas).\n\n";
+  std::shared_ptr<const BuildDocument> document;
+  string error;
+  if (!ReadDocument(input, &document, &error)) {
+    DieOnReaderError(filename(), error);
   }
-  CHECK(root.isArray()) << root;
+  ParseDocument(document);
+}
 
+void BuildFile::ParseFile() {
+  std::shared_ptr<const BuildDocument> document;
+  string error;
+  if (!ReadDocumentFile(filename(), &document, &error)) {
+    DieOnReaderError(filename(), error);
+  }
+  ParseDocument(document);
+}
+
+void BuildFile::ParseDocument(std::shared_ptr<const BuildDocument> document) {
+  // Our nodes point into (and share) the document, nothing is copied.
+  const BuildValue& root = document->root();
+  CHECK(root.is_array()) << root;
   for (int i = 0; i < root.size(); ++i) {
-    const Json::Value& value = root[i];
-    CHECK(value.isObject()) << "Unexpected: " << value;
-    nodes_.push_back(new BuildFileNode(value));
+    const BuildValue& value = root.item(i);
+    CHECK(value.is_object()) << "Unexpected: " << value;
+    nodes_.push_back(new BuildFileNode(&value, document));
+  }
+}
+
+// static
+bool BuildFile::ReadDocument(const string& input,
+                             std::shared_ptr<const BuildDocument>* document,
+                             string* error) {
+  BuildDocument* parsed = new BuildDocument;
+  document->reset(parsed);
+  BuildFileReader reader;
+  if (!reader.Read(input, parsed)) {
+    *error = reader.error();
+    return false;
   }
+  return true;
+}
+
+// static
+bool BuildFile::ReadDocumentFile(const string& filename,
+                                 std::shared_ptr<const BuildDocument>* document,
+                                 string* error) {
+  BuildDocument* parsed = new BuildDocument;
+  document->reset(parsed);
+  BuildFileReader reader;
+  if (!reader.ReadFile(filename, parsed)) {
+    *error = reader.error();
+    return false;
+  }
+  return true;
 }
 
 string BuildFile::NextName(const string& name_base) {
@@ -134,18 +201,19 @@ void BuildFileNodeReader::SetReplaceVariable(bool mode,
 void BuildFileNodeReader::ParseRepeatedString(const string& key,
                                               bool mode,
                                               vector<string>* output) const {
-  const Json::Value& array = GetValue(input_, key);
-  if (!array.isNull()) {
-    CHECK(array.isArray()) << "Expecting array for key " << key << ": "
-                           << input_.object();
+  const BuildValue& array = GetValue(input_, key);
+  if (!array.is_null()) {
+    CHECK(array.is_array()) << "Expecting array for key " << key << ": "
+                            << input_.object();
     for (int i = 0; i < array.size(); ++i) {
-      const Json::Value& single = array[i];
-      CHECK(single.isString()) << "Expecting string for item of " << key << ": "
-                               << input_.object()
-                               << ". Target: " << error_path_;
-      output->push_back(RewriteSingleString(mode, single.asString()));
+      const BuildValue& single = array.item(i);
+      CHECK(single.is_string()) << "Expecting string for item of " << key
+                                << ": " << input_.object()
+                                << ". Target: " << error_path_;
+      output->push_back(RewriteSingleString(
+          mode, single.string_value().as_string()));
       VLOG(1) << "Parsing string: "
-              << single.asString()
+              << single.string_value()
               << " (" << key << ", " << mode << ") => "
               << output->back();
     }
@@ -155,18 +223,20 @@ void BuildFileNodeReader::ParseRepeatedString(const string& key,
 void BuildFileNodeReader::ParseKeyValueStrings(
     const string& key,
     map<string, string>* output) const {
-  const Json::Value& list = input_.object()[key];
-  if (list.isNull()) {
+  const BuildValue& list = input_.object().Get(key);
+  if (list.is_null()) {
     return;
   }
-  CHECK(list.isObject())
+  CHECK(list.is_object())
       << "KeyValue list (\"" << key
       << "\") must be object in " << error_path_;
-  for (const string& name : list.getMemberNames()) {
-    const Json::Value& val = list[name];
-    CHECK(val.isString()) << "Value var (\"" << name
-                          << "\") must be string in " << error_path_;
-    (*output)[name] = RewriteSingleString(false, val.asString());
+  for (int i = 0; i < list.size(); ++i) {
+    const StringPiece& name = list.keys()[i];
+    const BuildValue& val = list.item(i);
+    CHECK(val.is_string()) << "Value var (\"" << name
+                           << "\") must be string in " << error_path_;
+    (*output)[name.as_string()] =
+        RewriteSingleString(false, val.string_value().as_string());
   }
 }
 
@@ -178,11 +248,12 @@ bool BuildFileNodeReader::ParseStringField(const string& key,
 bool BuildFileNodeReader::ParseStringField(const string& key,
                                            bool mode,
                                            string* field) const {
-  const Json::Value& json_field = GetValue(input_, key);
-  if (!json_field.isString()) {
+  const BuildValue& json_field = GetValue(input_, key);
+  if (!json_field.is_string()) {
     return false;
   }
-  *field = RewriteSingleString(mode, json_field.asString());
+  *field = RewriteSingleString(mode,
+                               json_field.string_value().as_string());
   return true;
 }
 
@@ -209,6 +280,8 @@ void BuildFileNodeReader::ParseFilesFromString(const vector<string>& input,
       }
     }
 
+    file_globs_.insert(glob);
+
     // Make sure we actually have this directory loaded in our system.
     vector<string> tmp;
     CHECK(dist_source_);
@@ -242,6 +315,25 @@ void BuildFileNodeReader::ParseSingleFile(const string& key,
   }
 }
 
+void BuildFileNodeReader::ParseKeyValueFiles(
+    const string& key,
+    map<string, Resource>* output) const {
+  map<string, string> files;
+  ParseKeyValueStrings(key, &files);
+  for (const auto& it : files) {
+    vector<string> fake;
+    fake.push_back(it.second);
+    vector<Resource> matched;
+    ParseFilesFromString(fake, strict_file_mode_, &matched);
+    if (matched.size() != 1) {
+      LOG(FATAL) << key << " (\"" << it.first << "\") must match exactly "
+                 << "1 file in " << error_path_ << ". Found "
+                 << matched.size() << " files.";
+    }
+    (*output)[it.first] = matched[0];
+  }
+}
+
 string BuildFileNodeReader::ParseSingleDirectory(const string& key) const {
   return ParseSingleDirectory(strict_file_mode_, key);
 }
@@ -262,11 +354,25 @@ string BuildFileNodeReader::ParseSingleDirectory(bool strict_file_mode,
 
 bool BuildFileNodeReader::ParseBoolField(const string& key,
                                          bool* field) const {
-  const Json::Value& json_field = GetValue(input_, key);
-  if (!json_field.isBool()) {
+  const BuildValue& json_field = GetValue(input_, key);
+  if (!json_field.is_bool()) {
+    return false;
+  }
+  *field = json_field.bool_value();
+  return true;
+}
+
+bool BuildFileNodeReader::ParseIntField(const string& key,
+                                        int* field) const {
+  const BuildValue& json_field = GetValue(input_, key);
+  if (!json_field.is_integral()) {
     return false;
   }
-  *field = json_field.asBool();
+  CHECK(json_field.type() != BuildValue::UINT_VALUE &&
+        json_field.int_value() >= std::numeric_limits<int>::min() &&
+        json_field.int_value() <= std::numeric_limits<int>::max())
+      << "Integer out of range for key " << key << " in " << error_path_;
+  *field = json_field.int_value();
   return true;
 }
 
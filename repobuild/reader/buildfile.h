@@ -10,6 +10,7 @@
 #include <string>
 #include <vector>
 #include "common/base/macros.h"
+#include "common/strings/stringpiece.h"
 #include "repobuild/env/target.h"
 
 namespace Json {
@@ -20,22 +21,31 @@ class VarMap;
 }
 
 namespace repobuild {
+class BuildDocument;
+class BuildValue;
 class DistSource;
 class Resource;
 
 class BuildFileNode {
  public:
-  explicit BuildFileNode(const Json::Value& object);
+  BuildFileNode();  // null object.
+  explicit BuildFileNode(const Json::Value& object);  // copies object.
+  BuildFileNode(const BuildValue* object /* member of document */,
+                std::shared_ptr<const BuildDocument> document);
   ~BuildFileNode();
 
   // Data source
-  const Json::Value& object() const { return *object_; }
+  const BuildValue& object() const { return *object_; }
+  const std::shared_ptr<const BuildDocument>& document() const {
+    return document_;
+  }
 
   // Mutators
   void Reset(const Json::Value& object);
 
  private:
-  std::unique_ptr<Json::Value> object_;
+  std::shared_ptr<const BuildDocument> document_;  // keeps object_ alive.
+  const BuildValue* object_;
 };
 
 class BuildFile {
@@ -47,6 +57,8 @@ class BuildFile {
 
   // Mutators
   void Parse(const std::string& input);
+  void ParseFile();  // reads filename(), see BuildFileReader.
+  void ParseDocument(std::shared_ptr<const BuildDocument> document);
   void MergeParent(BuildFile* parent);
   void MergeDependency(BuildFile* dependency);
   void AddBaseDependency(const std::string& dep) { base_deps_.insert(dep); }
@@ -76,6 +88,15 @@ class BuildFile {
   std::string NextName(const std::string& name_base);  // auto generated name.
   TargetInfo ComputeTargetInfo(const std::string& dependency) const;
 
+  // Reads a BUILD file from "input", returns false and fills in "error" on
+  // failure.
+  static bool ReadDocument(const std::string& input,
+                           std::shared_ptr<const BuildDocument>* document,
+                           std::string* error);
+  static bool ReadDocumentFile(const std::string& filename,
+                               std::shared_ptr<const BuildDocument>* document,
+                               std::string* error);
+
  private:
   std::string filename_;
   std::vector<BuildFileNode*> nodes_;
@@ -85,6 +106,22 @@ class BuildFile {
   std::map<std::string, std::string> registered_keys_;
 };
 
+// BuildFileCache
+//  Source of already-parsed BUILD file contents, so that a long running
+//  process (see repobuild/server) only re-reads the BUILD files that changed.
+class BuildFileCache {
+ public:
+  BuildFileCache() {}
+  virtual ~BuildFileCache() {}
+
+  // Returns the parsed contents of "filename", reading it if required.
+  virtual std::shared_ptr<const BuildDocument> GetBuildFile(
+      const std::string& filename) = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BuildFileCache);
+};
+
 // BuildFileNodeReader
 //  Helper that makes it easier to parse a BuildFileNode.
 class BuildFileNodeReader {
@@ -134,6 +171,10 @@ class BuildFileNodeReader {
                        bool strict_file_mode,
                        std::vector<Resource>* output) const;
 
+  // Parse { "name": "file", ... }, each file must match exactly one file.
+  void ParseKeyValueFiles(const std::string& key,
+                          std::map<std::string, Resource>* output) const;
+
   // Parsing a single directory
   std::string ParseSingleDirectory(const std::string& key) const;
   std::string ParseSingleDirectory(bool strict_file_mode,
@@ -143,6 +184,13 @@ class BuildFileNodeReader {
   bool ParseBoolField(const std::string& key,
                       bool* field) const;
 
+  // Parse int.
+  bool ParseIntField(const std::string& key,
+                     int* field) const;
+
+  // Every file glob we have parsed so far (matched or not).
+  const std::set<std::string>& file_globs() const { return file_globs_; }
+
  private:
   void ParseFilesFromString(const std::vector<std::string>& input,
                             bool strict_file_mode,
@@ -160,6 +208,7 @@ class BuildFileNodeReader {
   bool strict_file_mode_;
   std::string error_path_;
   std::string file_path_;
+  mutable std::set<std::string> file_globs_;
 };
 
 }  // namespace repobuild
@@ -0,0 +1,577 @@
+// Copyright 2013
+// Author: Christopher Van Arsdale
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "common/log/log.h"
+#include "common/strings/strutil.h"
+#include "repobuild/reader/buildfile_reader.h"
+#include "repobuild/third_party/json/json.h"
+
+using std::string;
+using std::vector;
+
+namespace repobuild {
+namespace {
+void AppendUtf8(unsigned int cp, string* out) {
+  if (cp <= 0x7F) {
+    out->push_back(static_cast<char>(cp));
+  } else if (cp <= 0x7FF) {
+    out->push_back(static_cast<char>(0xC0 | (0x1F & (cp >> 6))));
+    out->push_back(static_cast<char>(0x80 | (0x3F & cp)));
+  } else if (cp <= 0xFFFF) {
+    out->push_back(static_cast<char>(0xE0 | (0xF & (cp >> 12))));
+    out->push_back(static_cast<char>(0x80 | (0x3F & (cp >> 6))));
+    out->push_back(static_cast<char>(0x80 | (0x3F & cp)));
+  } else if (cp <= 0x10FFFF) {
+    out->push_back(static_cast<char>(0xF0 | (0x7 & (cp >> 18))));
+    out->push_back(static_cast<char>(0x80 | (0x3F & (cp >> 12))));
+    out->push_back(static_cast<char>(0x80 | (0x3F & (cp >> 6))));
+    out->push_back(static_cast<char>(0x80 | (0x3F & cp)));
+  }
+}
+
+bool IsNumberChar(char c) {
+  return ((c >= '0' && c <= '9') ||
+          c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-');
+}
+
+// KeyOrder
+//  Orders member indices by their keys.
+class KeyOrder {
+ public:
+  explicit KeyOrder(const vector<StringPiece>& keys) : keys_(keys) {}
+  bool operator()(int a, int b) const { return keys_[a] < keys_[b]; }
+
+ private:
+  const vector<StringPiece>& keys_;
+};
+}  // anonymous namespace
+
+const BuildValue& BuildValue::Get(const StringPiece& key) const {
+  static const BuildValue kNull;
+  if (type_ != OBJECT_VALUE) {
+    return kNull;
+  }
+  auto it = std::lower_bound(keys_.begin(), keys_.end(), key);
+  if (it == keys_.end() || *it != key) {
+    return kNull;
+  }
+  return items_[it - keys_.begin()];
+}
+
+void BuildValue::SortMembers() {
+  // Stable, and the last of equal keys wins (like Json::Reader).
+  vector<int> order(keys_.size());
+  for (int i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), KeyOrder(keys_));
+  vector<StringPiece> keys;
+  vector<BuildValue> items;
+  keys.reserve(order.size());
+  items.reserve(order.size());
+  for (int i = 0; i < order.size(); ++i) {
+    if (i + 1 < order.size() && keys_[order[i]] == keys_[order[i + 1]]) {
+      continue;
+    }
+    keys.push_back(keys_[order[i]]);
+    items.push_back(BuildValue());
+    items.back().swap(&items_[order[i]]);
+  }
+  keys_.swap(keys);
+  items_.swap(items);
+}
+
+void BuildValue::swap(BuildValue* other) {
+  std::swap(type_, other->type_);
+  std::swap(number_, other->number_);
+  std::swap(string_, other->string_);
+  keys_.swap(other->keys_);
+  items_.swap(other->items_);
+}
+
+void BuildValue::ToJson(Json::Value* json) const {
+  switch (type_) {
+    case NULL_VALUE:
+      *json = Json::Value();
+      break;
+    case BOOL_VALUE:
+      *json = Json::Value(bool_value());
+      break;
+    case INT_VALUE:
+      *json = Json::Value(Json::Value::LargestInt(number_.int_value));
+      break;
+    case UINT_VALUE:
+      *json = Json::Value(Json::Value::LargestUInt(number_.uint_value));
+      break;
+    case DOUBLE_VALUE:
+      *json = Json::Value(number_.double_value);
+      break;
+    case STRING_VALUE:
+      *json = Json::Value(string_.data(), string_.data() + string_.size());
+      break;
+    case ARRAY_VALUE:
+      *json = Json::Value(Json::arrayValue);
+      for (int i = 0; i < items_.size(); ++i) {
+        items_[i].ToJson(&(*json)[i]);
+      }
+      break;
+    case OBJECT_VALUE:
+      *json = Json::Value(Json::objectValue);
+      for (int i = 0; i < items_.size(); ++i) {
+        items_[i].ToJson(&(*json)[keys_[i].as_string()]);
+      }
+      break;
+  }
+}
+
+std::ostream& operator<<(std::ostream& out, const BuildValue& value) {
+  Json::Value json;
+  value.ToJson(&json);
+  return out << json;
+}
+
+BuildDocument::BuildDocument() : mapped_(NULL), mapped_size_(0) {
+}
+
+BuildDocument::~BuildDocument() {
+  Clear();
+}
+
+void BuildDocument::Clear() {
+  root_ = BuildValue();
+  strings_.clear();
+  contents_.clear();
+  if (mapped_ != NULL) {
+    munmap(const_cast<char*>(mapped_), mapped_size_);
+    mapped_ = NULL;
+    mapped_size_ = 0;
+  }
+}
+
+StringPiece BuildDocument::Store(const string& str) {
+  strings_.push_back(str);
+  return StringPiece(strings_.back().data(), strings_.back().size());
+}
+
+void BuildDocument::CopyFrom(const Json::Value& json) {
+  Clear();
+  CopyValue(json, &root_);
+}
+
+void BuildDocument::CopyValue(const Json::Value& json, BuildValue* value) {
+  switch (json.type()) {
+    case Json::nullValue:
+      value->type_ = BuildValue::NULL_VALUE;
+      break;
+    case Json::booleanValue:
+      value->type_ = BuildValue::BOOL_VALUE;
+      value->number_.int_value = json.asBool();
+      break;
+    case Json::intValue:
+      value->type_ = BuildValue::INT_VALUE;
+      value->number_.int_value = json.asLargestInt();
+      break;
+    case Json::uintValue:
+      value->type_ = BuildValue::UINT_VALUE;
+      value->number_.uint_value = json.asLargestUInt();
+      break;
+    case Json::realValue:
+      value->type_ = BuildValue::DOUBLE_VALUE;
+      value->number_.double_value = json.asDouble();
+      break;
+    case Json::stringValue:
+      value->type_ = BuildValue::STRING_VALUE;
+      value->string_ = Store(json.asString());
+      break;
+    case Json::arrayValue:
+      value->type_ = BuildValue::ARRAY_VALUE;
+      value->items_.resize(json.size());
+      for (int i = 0; i < json.size(); ++i) {
+        CopyValue(json[i], &value->items_[i]);
+      }
+      break;
+    case Json::objectValue:
+      value->type_ = BuildValue::OBJECT_VALUE;
+      for (const string& name : json.getMemberNames()) {  // sorted.
+        value->keys_.push_back(Store(name));
+        value->items_.push_back(BuildValue());
+        CopyValue(json[name], &value->items_.back());
+      }
+      break;
+  }
+}
+
+bool BuildFileReader::ReadFile(const string& filename,
+                               BuildDocument* document) {
+  document->Clear();
+  int fd = open(filename.c_str(), O_RDONLY);
+  LOG_IF(FATAL, fd < 0) << "Could not open " << filename << ": "
+                        << strerror(errno);
+  struct stat info;
+  LOG_IF(FATAL, fstat(fd, &info) != 0) << "Could not stat " << filename
+                                       << ": " << strerror(errno);
+  if (info.st_size > 0) {
+    void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    LOG_IF(FATAL, data == MAP_FAILED) << "Could not mmap " << filename
+                                      << ": " << strerror(errno);
+    document->mapped_ = static_cast<const char*>(data);
+    document->mapped_size_ = info.st_size;
+  }
+  close(fd);
+  return ReadDocument(document->mapped_,
+                      document->mapped_ + document->mapped_size_,
+                      document);
+}
+
+bool BuildFileReader::Read(const string& contents, BuildDocument* document) {
+  document->Clear();
+  document->contents_ = contents;
+  const char* begin = document->contents_.data();
+  return ReadDocument(begin, begin + document->contents_.size(), document);
+}
+
+bool BuildFileReader::ReadDocument(const char* begin,
+                                   const char* end,
+                                   BuildDocument* document) {
+  document_ = document;
+  begin_ = begin;
+  end_ = end;
+  current_ = begin;
+  error_.clear();
+
+  // NB: Like Json::Reader, we ignore anything after the root value.
+  return SkipSpaces() && ReadValue(&document->root_);
+}
+
+bool BuildFileReader::ReadValue(BuildValue* value) {
+  if (current_ == end_) {
+    return Error("Syntax error: value, object or array expected.", current_);
+  }
+  switch (*current_) {
+    case '{':
+      return ReadObject(value);
+    case '[':
+      return ReadArray(value);
+    case '"':
+      value->type_ = BuildValue::STRING_VALUE;
+      return ReadString(&value->string_);
+    case 't':
+      value->type_ = BuildValue::BOOL_VALUE;
+      value->number_.int_value = 1;
+      return Match("true");
+    case 'f':
+      value->type_ = BuildValue::BOOL_VALUE;
+      value->number_.int_value = 0;
+      return Match("false");
+    case 'n':
+      value->type_ = BuildValue::NULL_VALUE;
+      return Match("null");
+    default:
+      if ((*current_ >= '0' && *current_ <= '9') || *current_ == '-') {
+        return ReadNumber(value);
+      }
+      return Error("Syntax error: value, object or array expected.", current_);
+  }
+}
+
+bool BuildFileReader::ReadObject(BuildValue* value) {
+  value->type_ = BuildValue::OBJECT_VALUE;
+  ++current_;  // '{'
+  if (!SkipSpaces()) {
+    return false;
+  }
+  if (current_ != end_ && *current_ == '}') {  // empty object
+    ++current_;
+    return true;
+  }
+
+  while (true) {
+    if (current_ == end_ || *current_ != '"') {
+      return Error("Missing '}' or object member name", current_);
+    }
+    StringPiece name;
+    if (!ReadString(&name) || !SkipSpaces()) {
+      return false;
+    }
+    if (current_ == end_ || *current_ != ':') {
+      return Error("Missing ':' after object member name", current_);
+    }
+    ++current_;
+    value->keys_.push_back(name);
+    value->items_.push_back(BuildValue());
+    if (!SkipSpaces() || !ReadValue(&value->items_.back()) || !SkipSpaces()) {
+      return false;
+    }
+    if (current_ != end_ && *current_ == '}') {
+      ++current_;
+      value->SortMembers();
+      return true;
+    }
+    if (current_ == end_ || *current_ != ',') {
+      return Error("Missing ',' or '}' in object declaration", current_);
+    }
+    ++current_;
+    if (!SkipSpaces()) {
+      return false;
+    }
+  }
+}
+
+bool BuildFileReader::ReadArray(BuildValue* value) {
+  value->type_ = BuildValue::ARRAY_VALUE;
+  ++current_;  // '['
+  if (!SkipSpaces()) {
+    return false;
+  }
+  if (current_ != end_ && *current_ == ']') {  // empty array
+    ++current_;
+    return true;
+  }
+
+  while (true) {
+    value->items_.push_back(BuildValue());
+    if (!ReadValue(&value->items_.back()) || !SkipSpaces()) {
+      return false;
+    }
+    if (current_ != end_ && *current_ == ']') {
+      ++current_;
+      return true;
+    }
+    if (current_ == end_ || *current_ != ',') {
+      return Error("Missing ',' or ']' in array declaration", current_);
+    }
+    ++current_;
+    if (!SkipSpaces()) {
+      return false;
+    }
+  }
+}
+
+bool BuildFileReader::ReadString(StringPiece* str) {
+  // The common case, no escapes: a view of the file.
+  const char* start = current_;
+  const char* p = start + 1;
+  while (p != end_ && *p != '"' && *p != '\\') {
+    ++p;
+  }
+  if (p != end_ && *p == '"') {
+    *str = StringPiece(start + 1, p - start - 1);
+    current_ = p + 1;
+    return true;
+  }
+
+  // Unescaped into the document.
+  string unescaped(start + 1, p);
+  current_ = p;
+  if (!ReadEscapedString(start, &unescaped)) {
+    return false;
+  }
+  *str = document_->Store(unescaped);
+  return true;
+}
+
+bool BuildFileReader::ReadEscapedString(const char* start, string* str) {
+  while (current_ != end_) {
+    // Copy runs of plain characters at once.
+    const char* run = current_;
+    while (current_ != end_ && *current_ != '"' && *current_ != '\\') {
+      ++current_;
+    }
+    str->append(run, current_);
+    if (current_ == end_) {
+      break;
+    }
+    if (*current_++ == '"') {
+      return true;
+    }
+
+    // Escape sequence.
+    if (current_ == end_) {
+      break;
+    }
+    char escape = *current_++;
+    switch (escape) {
+      case '"': str->push_back('"'); break;
+      case '/': str->push_back('/'); break;
+      case '\\': str->push_back('\\'); break;
+      case 'b': str->push_back('\b'); break;
+      case 'f': str->push_back('\f'); break;
+      case 'n': str->push_back('\n'); break;
+      case 'r': str->push_back('\r'); break;
+      case 't': str->push_back('\t'); break;
+      case 'u': {
+        unsigned int cp;
+        if (!ReadUnicodeEscape(&cp)) {
+          return false;
+        }
+        if (cp >= 0xD800 && cp <= 0xDBFF) {  // surrogate pair.
+          unsigned int low;
+          if (end_ - current_ < 2 || current_[0] != '\\' ||
+              current_[1] != 'u') {
+            return Error("expecting another \\u token to begin the second "
+                         "half of a unicode surrogate pair", current_);
+          }
+          current_ += 2;
+          if (!ReadUnicodeEscape(&low)) {
+            return false;
+          }
+          cp = 0x10000 + ((cp & 0x3FF) << 10) + (low & 0x3FF);
+        }
+        AppendUtf8(cp, str);
+        break;
+      }
+      default:
+        return Error("Bad escape sequence in string", current_ - 1);
+    }
+  }
+  return Error("Missing '\"' at end of string", start);
+}
+
+bool BuildFileReader::ReadUnicodeEscape(unsigned int* code_point) {
+  if (end_ - current_ < 4) {
+    return Error("Bad unicode escape sequence in string: four digits "
+                 "expected.", current_);
+  }
+  *code_point = 0;
+  for (int i = 0; i < 4; ++i) {
+    char c = *current_++;
+    *code_point *= 16;
+    if (c >= '0' && c <= '9') {
+      *code_point += c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      *code_point += c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      *code_point += c - 'A' + 10;
+    } else {
+      return Error("Bad unicode escape sequence in string: hexadecimal "
+                   "digit expected.", current_ - 1);
+    }
+  }
+  return true;
+}
+
+bool BuildFileReader::ReadNumber(BuildValue* value) {
+  // Same rules as Json::Reader: integers that fit are Int/UInt, anything
+  // else (fractions, exponents, overflow) is a double.
+  const char* start = current_;
+  bool is_double = false;
+  while (current_ != end_ && IsNumberChar(*current_)) {
+    char c = *current_;
+    is_double = (is_double || c == '.' || c == 'e' || c == 'E' || c == '+' ||
+                 (c == '-' && current_ != start));
+    ++current_;
+  }
+
+  if (!is_double) {
+    const char* p = start;
+    bool negative = (*p == '-');
+    if (negative) {
+      ++p;
+    }
+    uint64_t max = negative ?
+        uint64_t(Json::Value::maxLargestInt) + 1 :
+        Json::Value::maxLargestUInt;
+    uint64_t number = 0;
+    for (; p != current_; ++p) {
+      unsigned int digit = *p - '0';
+      if (digit > 9) {
+        return Error("'" + string(start, current_) + "' is not a number.",
+                     start);
+      }
+      if (number > (max - digit) / 10) {
+        is_double = true;  // overflow.
+        break;
+      }
+      number = number * 10 + digit;
+    }
+    if (!is_double) {
+      if (negative) {
+        value->type_ = BuildValue::INT_VALUE;
+        value->number_.int_value = static_cast<int64_t>(0 - number);
+      } else if (number <= uint64_t(Json::Value::maxInt)) {
+        value->type_ = BuildValue::INT_VALUE;
+        value->number_.int_value = number;
+      } else {
+        value->type_ = BuildValue::UINT_VALUE;
+        value->number_.uint_value = number;
+      }
+      return true;
+    }
+  }
+
+  string number(start, current_);
+  char* number_end = NULL;
+  double parsed = strtod(number.c_str(), &number_end);
+  if (number_end == number.c_str()) {
+    return Error("'" + number + "' is not a number.", start);
+  }
+  value->type_ = BuildValue::DOUBLE_VALUE;
+  value->number_.double_value = parsed;
+  return true;
+}
+
+bool BuildFileReader::Match(const char* literal) {
+  size_t length = strlen(literal);
+  if (end_ - current_ < static_cast<ptrdiff_t>(length) ||
+      memcmp(current_, literal, length) != 0) {
+    return Error("Syntax error: value, object or array expected.", current_);
+  }
+  current_ += length;
+  return true;
+}
+
+bool BuildFileReader::SkipSpaces() {
+  while (current_ != end_) {
+    char c = *current_;
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+      ++current_;
+    } else if (c == '/' && end_ - current_ > 1 && current_[1] == '/') {
+      while (current_ != end_ && *current_ != '\n') {
+        ++current_;
+      }
+    } else if (c == '/' && end_ - current_ > 1 && current_[1] == '*') {
+      const char* start = current_;
+      current_ += 2;
+      while (current_ != end_ &&
+             !(*current_ == '*' && end_ - current_ > 1 && current_[1] == '/')) {
+        ++current_;
+      }
+      if (current_ == end_) {
+        return Error("Unterminated comment", start);
+      }
+      current_ += 2;
+    } else {
+      break;
+    }
+  }
+  return true;
+}
+
+bool BuildFileReader::Error(const string& message, const char* location) {
+  int line = 1;
+  const char* line_start = begin_;
+  for (const char* p = begin_; p != location && p != end_; ++p) {
+    if (*p == '\n') {
+      ++line;
+      line_start = p + 1;
+    }
+  }
+  error_ = strings::Join("* Line ", line, ", Column ",
+                         static_cast<int>(location - line_start) + 1, "\n  ",
+                         message, "\n");
+  return false;
+}
+
+}  // namespace repobuild
@@ -0,0 +1,169 @@
+// Copyright 2013
+// Author: Christopher Van Arsdale
+
+#ifndef _REPOBUILD_READER_BUILDFILE_READER_H__
+#define _REPOBUILD_READER_BUILDFILE_READER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "common/base/macros.h"
+#include "common/strings/stringpiece.h"
+
+namespace Json {
+class Value;
+}
+
+namespace repobuild {
+class BuildDocument;
+
+// BuildValue
+//  A json value of a BUILD file. Strings are views into the BuildDocument
+//  that owns the value: into the file itself, or into the document's own
+//  storage for strings with escape sequences. Object members are kept
+//  sorted by key, so lookups are a binary search, and they are visited in
+//  the same order as Json::Value::getMemberNames().
+class BuildValue {
+ public:
+  enum Type {
+    NULL_VALUE,
+    BOOL_VALUE,
+    INT_VALUE,
+    UINT_VALUE,
+    DOUBLE_VALUE,
+    STRING_VALUE,
+    ARRAY_VALUE,
+    OBJECT_VALUE
+  };
+
+  BuildValue() : type_(NULL_VALUE) {}
+
+  Type type() const { return type_; }
+  bool is_null() const { return type_ == NULL_VALUE; }
+  bool is_bool() const { return type_ == BOOL_VALUE; }
+  bool is_integral() const {  // like Json::Value, bools are integral.
+    return type_ == BOOL_VALUE || type_ == INT_VALUE || type_ == UINT_VALUE;
+  }
+  bool is_string() const { return type_ == STRING_VALUE; }
+  bool is_array() const { return type_ == ARRAY_VALUE; }
+  bool is_object() const { return type_ == OBJECT_VALUE; }
+
+  bool bool_value() const { return number_.int_value != 0; }
+  int64_t int_value() const { return number_.int_value; }
+  const StringPiece& string_value() const { return string_; }
+
+  // Arrays and objects.
+  int size() const { return items_.size(); }
+  const BuildValue& item(int i) const { return items_[i]; }
+
+  // Objects: the (sorted) member names, and the value of "key" (a null
+  // value if we have no such member, or are not an object).
+  const std::vector<StringPiece>& keys() const { return keys_; }
+  const BuildValue& Get(const StringPiece& key) const;
+
+  // Conversion to/from json, for plugins and error messages.
+  void ToJson(Json::Value* json) const;
+
+ private:
+  friend class BuildDocument;
+  friend class BuildFileReader;
+
+  void SortMembers();
+  void swap(BuildValue* other);
+
+  Type type_;
+  union {
+    int64_t int_value;  // also bools.
+    uint64_t uint_value;
+    double double_value;
+  } number_;
+  StringPiece string_;
+  std::vector<StringPiece> keys_;  // objects, same order as items_.
+  std::vector<BuildValue> items_;  // arrays and objects.
+};
+
+std::ostream& operator<<(std::ostream& out, const BuildValue& value);
+
+// BuildDocument
+//  The contents of a BUILD file (memory mapped, or a copy of a string) and
+//  the BuildValue tree that points into them.
+class BuildDocument {
+ public:
+  BuildDocument();
+  ~BuildDocument();
+
+  const BuildValue& root() const { return root_; }
+
+  // Copies "json" (e.g. the output of a plugin) into a new document.
+  void CopyFrom(const Json::Value& json);
+
+ private:
+  friend class BuildFileReader;
+  DISALLOW_COPY_AND_ASSIGN(BuildDocument);
+
+  void Clear();
+  StringPiece Store(const std::string& str);
+  void CopyValue(const Json::Value& json, BuildValue* value);
+
+  BuildValue root_;
+  std::string contents_;  // unless mapped.
+  const char* mapped_;
+  size_t mapped_size_;
+  std::deque<std::string> strings_;  // that are not in the contents as-is.
+};
+
+// BuildFileReader
+//  Reads the json of a BUILD file. This is on the hot path of every
+//  repobuild run, so rather than going through Json::Reader (a copy of the
+//  file, a token stream, a node stack, collected comments and a Json::Value
+//  with its own std::string per string and key) we memory map the file and
+//  parse it in a single pass into BuildValues that refer to it.
+//
+//  Accepts what Json::Reader accepts for BUILD files: standard json plus
+//  // and /* */ comments. Comments are dropped. Plugin output is still read
+//  with Json::Reader (see nodes/plugin.cc).
+class BuildFileReader {
+ public:
+  BuildFileReader() {}
+  ~BuildFileReader() {}
+
+  // Reads the file "filename" into "document". Returns false on a syntax
+  // error (see error()), dies if the file cannot be read.
+  bool ReadFile(const std::string& filename, BuildDocument* document);
+
+  // Reads (a copy of) "contents" into "document". Returns false on a syntax
+  // error.
+  bool Read(const std::string& contents, BuildDocument* document);
+
+  // Formatted like Json::Reader::getFormattedErrorMessages().
+  const std::string& error() const { return error_; }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BuildFileReader);
+
+  bool ReadDocument(const char* begin, const char* end,
+                    BuildDocument* document);
+  bool ReadValue(BuildValue* value);
+  bool ReadObject(BuildValue* value);
+  bool ReadArray(BuildValue* value);
+  bool ReadString(StringPiece* str);
+  bool ReadEscapedString(const char* start, std::string* str);
+  bool ReadNumber(BuildValue* value);
+  bool ReadUnicodeEscape(unsigned int* code_point);
+  bool Match(const char* literal);
+  bool SkipSpaces();  // and comments, false on an unterminated comment.
+  bool Error(const std::string& message, const char* location);
+
+  BuildDocument* document_;
+  const char* begin_;
+  const char* end_;
+  const char* current_;
+  std::string error_;
+};
+
+}  // namespace repobuild
+
+#endif  // _REPOBUILD_READER_BUILDFILE_READER_H__
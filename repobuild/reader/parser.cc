@@ -16,8 +16,8 @@
 #include "repobuild/nodes/node.h"
 #include "repobuild/nodes/allnodes.h"
 #include "repobuild/reader/buildfile.h"
+#include "repobuild/reader/buildfile_reader.h"
 #include "repobuild/reader/parser.h"
-#include "repobuild/third_party/json/json.h"
 
 using std::map;
 using std::set;
@@ -36,16 +36,16 @@ Node* ParseNode(const NodeBuilderSet* builder_set,
                 DistSource* dist_source,
                 const Input& input,
                 const string& key) {
-  const Json::Value& value = file_node->object()[key];
-  const Json::Value& name = value["name"];
+  const BuildValue& value = file_node->object().Get(key);
+  const BuildValue& name = value.Get("name");
 
   // Generate a name for this target.
   string node_name;
-  if (!name.isNull()) {
-    LOG_IF(FATAL, !name.isString()) << "Require string value of \"name\", "
-                                    << "found " << name << " in file "
-                                    << file->filename();
-    node_name = name.asString();
+  if (!name.is_null()) {
+    LOG_IF(FATAL, !name.is_string()) << "Require string value of \"name\", "
+                                     << "found " << name << " in file "
+                                     << file->filename();
+    node_name = name.string_value().as_string();
   } else {
     node_name = file->NextName("auto_");
   }
@@ -54,7 +54,7 @@ Node* ParseNode(const NodeBuilderSet* builder_set,
   TargetInfo target(":" + node_name, file->filename());
   Node* node = builder_set->NewNode(key, target, input, dist_source);
   LOG_IF(FATAL, node == NULL) << "Uknown build rule: " << key;
-  node->Parse(file, BuildFileNode(value));
+  node->Parse(file, BuildFileNode(&value, file_node->document()));
   return node;
 }
 
@@ -78,9 +78,11 @@ class Graph {
  public:
   Graph(const Input& input,
         const NodeBuilderSet* builder_set,
-        DistSource* dist_source)
+        DistSource* dist_source,
+        BuildFileCache* build_cache)
       : input_(input),
         dist_source_(dist_source),
+        build_cache_(build_cache),
         builder_set_(builder_set) {
     Parse();
   }
@@ -171,18 +173,21 @@ class Graph {
     ProcessParent(file);  // inherit anything we need to from parents.
 
     // Parse the BUILD into a structured format.
-    string filestr = file::ReadFileToStringOrDie(file->filename());
-    file->Parse(filestr);
+    if (build_cache_ != NULL) {
+      file->ParseDocument(build_cache_->GetBuildFile(file->filename()));
+    } else {
+      file->ParseFile();
+    }
 
     // Get the dependent files.
     vector<Node*> nodes;
     for (BuildFileNode* node : file->nodes()) {
-      LOG_IF(FATAL, !node->object().isObject())
+      LOG_IF(FATAL, !node->object().is_object())
           << "Expected json object (file = " << file->filename() << "): "
           << node->object();
-      for (const string& key : node->object().getMemberNames()) {
+      for (const StringPiece& key : node->object().keys()) {
         if (key == "config" || key == "plugin") {
-          ParseSingleNode(file, node, key, &nodes);
+          ParseSingleNode(file, node, key.as_string(), &nodes);
         }
       }
     }
@@ -199,17 +204,18 @@ class Graph {
       bool expand_plugin = true;
       while (expand_plugin) {
         expand_plugin = false;
-        for (const string& key : node->object().getMemberNames()) {
-          if (ExpandPlugin(file, node, key)) {
+        // NB: an expanded node is Reset(), so we stop iterating its keys.
+        for (const StringPiece& key : node->object().keys()) {
+          if (ExpandPlugin(file, node, key.as_string())) {
             expand_plugin = true;
             break;
           }
         }
       }
 
-      for (const string& key : node->object().getMemberNames()) {
+      for (const StringPiece& key : node->object().keys()) {
         if (key != "config" && key != "plugin") {
-          ParseSingleNode(file, node,  key, &nodes);
+          ParseSingleNode(file, node, key.as_string(), &nodes);
         }
       }
     }
@@ -332,6 +338,7 @@ class Graph {
   // Our inputs
   const Input& input_;
   DistSource* dist_source_;
+  BuildFileCache* build_cache_;  // may be null.
 
   // The generated data.
   const NodeBuilderSet* builder_set_;
@@ -347,7 +354,8 @@ class Graph {
 
 Parser::Parser(const NodeBuilderSet* builder_set, DistSource* source)
     : builder_set_(builder_set),
-      dist_source_(source) {
+      dist_source_(source),
+      build_cache_(NULL) {
 }
 
 Parser::~Parser() {
@@ -357,7 +365,7 @@ Parser::~Parser() {
 void Parser::Parse(const Input& input) {
   Reset();
 
-  Graph graph(input, builder_set_, dist_source_);
+  Graph graph(input, builder_set_, dist_source_, build_cache_);
   graph.Extract(&input_nodes_, &all_nodes_, &builds_);
   for (auto it : all_nodes_) {
     all_node_vec_.push_back(it.second);
@@ -10,6 +10,7 @@
 namespace repobuild {
 
 class BuildFile;
+class BuildFileCache;
 class DistSource;
 class Input;
 class Node;
@@ -23,6 +24,9 @@ class Parser {
 
   // Mutators.
   void Parse(const Input& input);
+  void SetBuildFileCache(BuildFileCache* cache /* keeps reference */) {
+    build_cache_ = cache;
+  }
 
   // Accessors.
   const Input& input() const { return *input_; }
@@ -50,6 +54,7 @@ class Parser {
 
   const NodeBuilderSet* builder_set_;
   DistSource* dist_source_;
+  BuildFileCache* build_cache_;
   std::unique_ptr<Input> input_;
   std::vector<Node*> input_nodes_, all_node_vec_;
   std::map<std::string, BuildFile*> builds_;
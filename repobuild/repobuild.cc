@@ -15,6 +15,14 @@
 // 2) With repobuild itself:
 //  ./repbuild ":repobuild" && make repobuild
 //
+// To list targets/tests affected by a change (instead of writing a makefile):
+//  ./repobuild --affected_revisions=HEAD~1..HEAD ":allrec"
+//  ./repobuild --affected_files=path/to/file.cc,path/to/BUILD ":allrec"
+//
+// To keep parsed state around between runs (see server/build_server.h):
+//  ./repobuild --server &
+//  ./repobuild --use_server ":repobuild"
+//
 
 #include <iostream>
 #include <vector>
@@ -28,13 +36,39 @@
 #include "repobuild/distsource/dist_source_impl.h"
 #include "repobuild/env/input.h"
 #include "repobuild/env/target.h"
+#include "repobuild/generator/affected_targets.h"
 #include "repobuild/generator/generator.h"
+#include "repobuild/server/build_server.h"
 
+using std::string;
 using std::vector;
 
 DEFINE_string(makefile, "Makefile",
               "Name of makefile output.");
 
+DEFINE_string(affected_files, "",
+              "If set, comma separated list of changed files. Instead of a "
+              "makefile, we print (json) which of our targets and tests are "
+              "affected by them.");
+
+DEFINE_string(affected_revisions, "",
+              "Like --affected_files, but uses the files changed in a git "
+              "revision range (e.g. \"origin/master..HEAD\"), or between a "
+              "single revision and the working directory.");
+
+DEFINE_bool(server, false,
+            "If true, we stay resident and generate makefiles for "
+            "--use_server clients (see --server_socket).");
+
+DEFINE_bool(use_server, false,
+            "If true, we ask a running repobuild --server to generate the "
+            "makefile, and only generate it ourselves if that fails. Our "
+            "command line flags are applied by the server for this request "
+            "only.");
+
+DEFINE_string(server_socket, ".gen-files/repobuild.sock",
+              "Unix socket used by --server and --use_server.");
+
 namespace {
 const char* kUsage =
     "\n\n"
@@ -66,16 +100,32 @@ void ParseArg(bool no_flags,
     input->AddBuildTarget(repobuild::TargetInfo::FromUserPath(arg.as_string()));
   }
 }
+
+// Arguments before "--" may be repobuild flags, anything after is a target.
+void ParseArgs(const vector<string>& args, repobuild::Input* input) {
+  bool no_flags = false;
+  for (const string& arg : args) {
+    if (!no_flags && arg == "--") {
+      no_flags = true;
+      continue;
+    }
+    ParseArg(no_flags, arg, input);
+  }
+}
 }  // anonymous namespace
 
 int main(int argc, char** argv) {
   // Strip out any single '-' type arguments.
   vector<char*> saved_args, ignored_args;
+  vector<string> flag_args;  // for --use_server.
   bool ignore_all = false;
   for (int i = 0 /* 0 == binary name */; i < argc; ++i) {
     ignore_all |= !strcmp(argv[i], "--");
     if (i == 0 || ignore_all || !strncmp(argv[i], "--", 2)) {
       ignored_args.push_back(argv[i]);
+      if (i > 0 && !ignore_all) {
+        flag_args.push_back(argv[i]);
+      }
     } else {
       saved_args.push_back(argv[i]);
     }
@@ -86,23 +136,61 @@ int main(int argc, char** argv) {
   char** args = &ignored_args[0];
   InitProgram(&size, &args, kUsage, true);
 
-  // Parse arguments.
+  // Gather arguments.
   // 1) Arguments for compilation (-C=a, -X=a, -L=a, etc ... see env/input.cc)
   // 2) Build targets (e.g. ":repobuild" "common/strings/testing:strutil_test")
-  repobuild::Input input;
+  vector<string> user_args;
   for (const char* arg_input : saved_args) {
     if (!strcmp(arg_input, "--")) {
       break;
     }
-    ParseArg(false, arg_input, &input);
+    user_args.push_back(arg_input);
   }
+  user_args.push_back("--");
   for (int i = 1 /* binary name */; i < size; ++i) {
-    ParseArg(true, args[i], &input);
+    user_args.push_back(args[i]);
+  }
+
+  if (FLAGS_server) {
+    repobuild::Input input;
+    repobuild::DistSourceImpl source(input.full_root_dir());
+    repobuild::BuildServer server(FLAGS_server_socket, &source, &ParseArgs);
+    return server.Run() ? 0 : 1;
+  }
+  // The server only writes makefiles, --affected_* is always answered here.
+  const bool affected = (!FLAGS_affected_files.empty() ||
+                         !FLAGS_affected_revisions.empty());
+  if (FLAGS_use_server && !affected) {
+    bool success = false;
+    if (repobuild::BuildServer::RemoteGenerate(FLAGS_server_socket,
+                                               FLAGS_makefile,
+                                               flag_args,
+                                               user_args,
+                                               &success)) {
+      return success ? 0 : 1;
+    }
+    VLOG(1) << "No repobuild server, generating locally.";
   }
 
+  // Parse arguments.
+  repobuild::Input input;
+  ParseArgs(user_args, &input);
+
   // Set up our distributed source tree.
   repobuild::DistSourceImpl source(input.full_root_dir());
 
+  // Print out affected targets, if requested.
+  if (affected) {
+    vector<string> changed = strings::SplitString(FLAGS_affected_files, ",");
+    if (!FLAGS_affected_revisions.empty() &&
+        !source.ChangedFiles(FLAGS_affected_revisions, &changed)) {
+      LOG(FATAL) << "Could not read changes for " << FLAGS_affected_revisions;
+    }
+    repobuild::AffectedTargets affected(&source);
+    std::cout << affected.Generate(input, changed);
+    return 0;
+  }
+
   // Generate the output Makefile.
   repobuild::Generator generator(&source);
   file::WriteFileOrDie(strings::JoinPath(input.root_dir(), FLAGS_makefile),
@@ -0,0 +1,800 @@
+// Copyright 2013
+// Author: Christopher Van Arsdale
+
+#include <errno.h>
+#include <fnmatch.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "common/base/flags.h"
+#include "common/log/log.h"
+#include "common/file/fileutil.h"
+#include "common/strings/path.h"
+#include "common/strings/strutil.h"
+#include "common/util/stl.h"
+#include "repobuild/distsource/dist_source.h"
+#include "repobuild/env/input.h"
+#include "repobuild/generator/generator.h"
+#include "repobuild/reader/buildfile.h"
+#include "repobuild/server/build_server.h"
+
+using std::map;
+using std::set;
+using std::string;
+using std::shared_ptr;
+using std::vector;
+
+namespace repobuild {
+namespace {
+// Wire format: NUL separated fields, terminated by the client closing its
+// write side. Request is [cwd, makefile, #flags, flags..., args...], response
+// is kOk or kError followed by an error message.
+const char kOk[] = "ok";
+const char kError[] = "error\n";
+
+// What a generation child reports back: the makefile, then the BUILD files
+// and globs it read that the server had not cached yet.
+const char kReadBuildFile = 'b';
+const char kReadGlob = 'g';
+
+string DirectoryOf(const string& path) {
+  string dir = strings::PathDirname(path);
+  return dir.empty() ? "." : dir;
+}
+
+string StripDotSlash(const string& path) {
+  return strings::HasPrefix(path, "./") ? path.substr(2) : path;
+}
+
+bool HasWildcard(const string& glob) {
+  return glob.find_first_of("*?[") != string::npos;
+}
+
+bool ReadAll(int fd, string* out) {
+  char buffer[4096];
+  while (true) {
+    ssize_t len = read(fd, buffer, sizeof(buffer));
+    if (len == 0) {
+      return true;
+    } else if (len < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    out->append(buffer, len);
+  }
+}
+
+bool WriteAll(int fd, const string& data) {
+  size_t pos = 0;
+  while (pos < data.size()) {
+    ssize_t len = write(fd, data.data() + pos, data.size() - pos);
+    if (len < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    pos += len;
+  }
+  return true;
+}
+
+// Reads both pipes until they are closed.
+bool ReadPipes(int out_fd, int err_fd, string* out, string* err) {
+  struct pollfd fds[2];
+  fds[0].fd = out_fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = err_fd;
+  fds[1].events = POLLIN;
+  string* outputs[2] = { out, err };
+  int open = 2;
+  char buffer[4096];
+  while (open > 0) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    for (int i = 0; i < 2; ++i) {
+      if (fds[i].fd < 0 || fds[i].revents == 0) {
+        continue;
+      }
+      ssize_t len = read(fds[i].fd, buffer, sizeof(buffer));
+      if (len < 0 && errno == EINTR) {
+        continue;
+      }
+      if (len <= 0) {
+        close(fds[i].fd);
+        fds[i].fd = -1;  // ignored by poll().
+        --open;
+        continue;
+      }
+      outputs[i]->append(buffer, len);
+    }
+  }
+  return true;
+}
+
+vector<string> SplitFields(const string& data) {
+  vector<string> fields;
+  size_t start = 0;
+  for (size_t pos = data.find('\0'); pos != string::npos;
+       start = pos + 1, pos = data.find('\0', start)) {
+    fields.push_back(data.substr(start, pos - start));
+  }
+  return fields;
+}
+
+bool MakeSocketAddress(const string& path, struct sockaddr_un* addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr->sun_path)) {
+    LOG(ERROR) << "Socket path too long: " << path;
+    return false;
+  }
+  strncpy(addr->sun_path, path.c_str(), sizeof(addr->sun_path) - 1);
+  return true;
+}
+
+int ConnectTo(const string& path) {
+  struct sockaddr_un addr;
+  if (!MakeSocketAddress(path, &addr)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+              sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void MakeParentDirectories(const string& path) {
+  string dir = strings::PathDirname(path);
+  if (dir.empty() || dir == "." || dir == "/") {
+    return;
+  }
+  MakeParentDirectories(dir);
+  mkdir(dir.c_str(), 0755);  // may already exist.
+}
+
+// FileWatcher
+//  Thin wrapper around inotify. Watches directories (not files), since most
+//  editors replace files by renaming over them.
+class FileWatcher {
+ public:
+  struct Event {
+    string path;
+    bool listing_changed;  // file created/deleted/renamed.
+    bool is_dir;
+  };
+
+  FileWatcher() : fd_(-1) {
+#ifdef __linux__
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0) {
+      LOG(WARNING) << "Could not initialize inotify (" << strerror(errno)
+                   << "), regenerating everything on every request.";
+    }
+#endif
+  }
+
+  ~FileWatcher() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  bool enabled() const { return fd_ >= 0; }
+  int fd() const { return fd_; }
+
+  // Returns true if "dir" is (now) being watched.
+  bool Watch(const string& dir) {
+#ifdef __linux__
+    if (fd_ < 0) {
+      return false;
+    }
+    if (ContainsKey(dirs_, dir)) {
+      return true;
+    }
+    const uint32_t kMask = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                           IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF |
+                           IN_MOVE_SELF | IN_ONLYDIR;
+    int wd = inotify_add_watch(fd_, dir.c_str(), kMask);
+    if (wd < 0) {
+      VLOG(1) << "Could not watch " << dir << ": " << strerror(errno);
+      return false;
+    }
+    dirs_[dir] = wd;
+    watches_[wd] = dir;
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // Reads any pending events. Returns false if we lost track of some events
+  // (queue overflow, a watched directory went away), in which case everything
+  // we cached is suspect.
+  bool ReadEvents(vector<Event>* events) {
+    bool complete = true;
+#ifdef __linux__
+    if (fd_ < 0) {
+      return true;
+    }
+    char buffer[16384]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true) {
+      ssize_t len = read(fd_, buffer, sizeof(buffer));
+      if (len <= 0) {
+        break;  // EAGAIN, nothing left.
+      }
+      const struct inotify_event* event = NULL;
+      for (char* ptr = buffer; ptr < buffer + len;
+           ptr += sizeof(struct inotify_event) + event->len) {
+        event = reinterpret_cast<const struct inotify_event*>(ptr);
+        if (event->mask & IN_Q_OVERFLOW) {
+          complete = false;
+          continue;
+        }
+        auto it = watches_.find(event->wd);
+        if (it == watches_.end()) {
+          continue;
+        }
+        if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+          complete = false;
+          if (event->mask & IN_IGNORED) {
+            dirs_.erase(it->second);
+            watches_.erase(it);
+          }
+          continue;
+        }
+        const string name = event->len > 0 ? string(event->name) : "";
+        if (name.empty() || name[0] == '.') {
+          continue;  // globs do not match dot files.
+        }
+        Event out;
+        out.path = it->second == "." ? name
+                                     : strings::JoinPath(it->second, name);
+        out.listing_changed = (event->mask & (IN_CREATE | IN_DELETE |
+                                              IN_MOVED_FROM | IN_MOVED_TO));
+        out.is_dir = (event->mask & IN_ISDIR);
+        events->push_back(out);
+      }
+    }
+#endif
+    return complete;
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FileWatcher);
+
+  int fd_;
+  map<string, int> dirs_;
+  map<int, string> watches_;
+};
+
+// WatchedBuildFileCache
+//  Keeps the parsed contents of every BUILD file we read, until the watcher
+//  tells us it changed.
+class WatchedBuildFileCache : public BuildFileCache {
+ public:
+  explicit WatchedBuildFileCache(FileWatcher* watcher)
+      : watcher_(watcher) {
+  }
+  virtual ~WatchedBuildFileCache() {}
+
+  // Only called in generation children, which report errors by dying.
+  virtual shared_ptr<const BuildDocument> GetBuildFile(const string& filename) {
+    const string key = StripDotSlash(filename);
+    auto it = files_.find(key);
+    if (it != files_.end()) {
+      return it->second;
+    }
+    string error;
+    shared_ptr<const BuildDocument> document;
+    if (!Load(key, &document, &error)) {
+      LOG(FATAL) << error;
+    }
+    if (watcher_->Watch(DirectoryOf(key))) {
+      // Otherwise we cannot tell when this goes stale, so only our nodes
+      // keep it.
+      files_[key] = document;
+      read_.push_back(key);
+    }
+    return document;
+  }
+
+  // Caches "filename" if we can watch it, as read by a generation child.
+  void Preload(const string& filename) {
+    if (ContainsKey(files_, filename)) {
+      return;
+    }
+    string error;
+    shared_ptr<const BuildDocument> document;
+    if (Load(filename, &document, &error) &&
+        watcher_->Watch(DirectoryOf(filename))) {
+      files_[filename] = document;
+    }
+  }
+
+  // BUILD files read (and cached) since the last call.
+  vector<string> TakeRead() {
+    vector<string> read;
+    swap(read, read_);
+    return read;
+  }
+
+  // Returns true if "path" was a cached BUILD file.
+  bool Invalidate(const string& path) {
+    if (files_.erase(path) == 0) {
+      return false;
+    }
+    stale_.insert(path);
+    return true;
+  }
+
+  // Re-reads BUILD files that changed since the last request, so we can
+  // report syntax errors to the client rather than dying.
+  bool Revalidate(string* error) {
+    set<string> stale;
+    swap(stale, stale_);
+    for (const string& path : stale) {
+      vector<string> exists;
+      if (!file::Glob(path, &exists) || exists.empty()) {
+        continue;  // deleted, the parser reports it if it is still needed.
+      }
+      shared_ptr<const BuildDocument> document;
+      if (!Load(path, &document, error)) {
+        stale_.insert(path);
+        return false;
+      }
+      if (watcher_->Watch(DirectoryOf(path))) {
+        files_[path] = document;
+      }
+    }
+    return true;
+  }
+
+  void Clear() {
+    files_.clear();
+    stale_.clear();
+    read_.clear();
+  }
+
+ private:
+  static bool Load(const string& filename,
+                   shared_ptr<const BuildDocument>* document,
+                   string* error) {
+    if (!BuildFile::ReadDocumentFile(filename, document, error)) {
+      *error = strings::Join("BUILD file reader error\n\nIn ", filename,
+                             ":\n ", *error,
+                             "\n\n(check for missing/spurious commas).\n\n");
+      return false;
+    }
+    return true;
+  }
+
+  FileWatcher* watcher_;
+  map<string, shared_ptr<const BuildDocument> > files_;
+  set<string> stale_;
+  vector<string> read_;
+};
+
+// WatchedDistSource
+//  Caches glob results of the underlying DistSource, keyed by glob, and
+//  drops them when files appear/disappear in the directories they cover.
+class WatchedDistSource : public DistSource {
+ public:
+  WatchedDistSource(DistSource* source, FileWatcher* watcher)
+      : source_(source),
+        watcher_(watcher) {
+  }
+  virtual ~WatchedDistSource() {}
+
+  virtual void InitializeForFile(const string& glob, vector<string>* files) {
+    auto it = globs_.find(glob);
+    if (it == globs_.end()) {
+      vector<string> matched;
+      source_->InitializeForFile(glob, &matched);
+      if (!WatchGlob(glob, matched)) {
+        if (files != NULL) {
+          files->insert(files->end(), matched.begin(), matched.end());
+        }
+        return;
+      }
+      it = globs_.insert(make_pair(glob, matched)).first;
+      read_.push_back(glob);
+    }
+    if (files != NULL) {
+      files->insert(files->end(), it->second.begin(), it->second.end());
+    }
+  }
+
+  virtual void WriteMakeFile(Makefile* out) { source_->WriteMakeFile(out); }
+  virtual void WriteMakeClean(Makefile::Rule* out) {
+    source_->WriteMakeClean(out);
+  }
+  virtual void WriteMakeHead(const Input& input, Makefile* out) {
+    source_->WriteMakeHead(input, out);
+  }
+
+  // "path" was created or removed. Returns true if any glob result changed.
+  bool InvalidatePath(const string& path) {
+    auto it = dir_globs_.find(DirectoryOf(path));
+    if (it == dir_globs_.end()) {
+      return false;
+    }
+    bool changed = false;
+    set<string> globs = it->second;
+    for (const string& glob : globs) {
+      const string pattern = StripDotSlash(glob);
+      if (DirectoryOf(pattern) == DirectoryOf(path) &&
+          fnmatch(pattern.c_str(), path.c_str(), FNM_PATHNAME) != 0) {
+        continue;  // same directory, but does not match.
+      }
+      globs_.erase(glob);
+      it->second.erase(glob);
+      changed = true;
+    }
+    return changed;
+  }
+
+  // Globs expanded (and cached) since the last call.
+  vector<string> TakeRead() {
+    vector<string> read;
+    swap(read, read_);
+    return read;
+  }
+
+  void Clear() {
+    globs_.clear();
+    dir_globs_.clear();
+    read_.clear();
+  }
+
+ private:
+  bool WatchGlob(const string& glob, const vector<string>& matched) {
+    const string pattern = StripDotSlash(glob);
+    set<string> dirs;
+    if (!HasWildcard(DirectoryOf(pattern))) {
+      dirs.insert(DirectoryOf(pattern));
+    } else {
+      // Wildcard directories, watch the fixed prefix and every match.
+      vector<string> fixed;
+      for (const string& part : strings::SplitString(pattern, "/")) {
+        if (HasWildcard(part)) {
+          break;
+        }
+        fixed.push_back(part);
+      }
+      dirs.insert(fixed.empty() ? "." : strings::JoinAll(fixed, "/"));
+      for (const string& file : matched) {
+        dirs.insert(DirectoryOf(StripDotSlash(file)));
+      }
+    }
+    for (const string& dir : dirs) {
+      if (!watcher_->Watch(dir)) {
+        return false;
+      }
+    }
+    for (const string& dir : dirs) {
+      dir_globs_[dir].insert(glob);
+    }
+    return true;
+  }
+
+  DistSource* source_;
+  FileWatcher* watcher_;
+  map<string, vector<string> > globs_;
+  map<string, set<string> > dir_globs_;
+  vector<string> read_;
+};
+
+}  // anonymous namespace
+
+struct BuildServer::ServerData {
+  explicit ServerData(DistSource* source)
+      : build_cache(&watcher),
+        dist_source(source, &watcher),
+        dirty(true) {
+  }
+
+  FileWatcher watcher;
+  WatchedBuildFileCache build_cache;
+  WatchedDistSource dist_source;
+
+  // Last generated makefile, valid until "dirty" is set.
+  string last_request;
+  string last_makefile;
+  bool dirty;
+};
+
+BuildServer::BuildServer(const string& socket_path,
+                         DistSource* source,
+                         InputParser parser)
+    : socket_path_(socket_path),
+      parser_(parser),
+      data_(new ServerData(source)) {
+}
+
+BuildServer::~BuildServer() {
+}
+
+bool BuildServer::Run() {
+  int existing = ConnectTo(socket_path_);
+  if (existing >= 0) {
+    close(existing);
+    LOG(ERROR) << "A repobuild server is already listening on "
+               << socket_path_;
+    return false;
+  }
+
+  struct sockaddr_un addr;
+  if (!MakeSocketAddress(socket_path_, &addr)) {
+    return false;
+  }
+  MakeParentDirectories(socket_path_);
+  unlink(socket_path_.c_str());  // stale, from a server that went away.
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0 ||
+      bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr),
+           sizeof(addr)) != 0 ||
+      listen(listen_fd, 16) != 0) {
+    LOG(ERROR) << "Could not listen on " << socket_path_ << ": "
+               << strerror(errno);
+    return false;
+  }
+  signal(SIGPIPE, SIG_IGN);  // clients may go away mid-response.
+  LOG(INFO) << "repobuild server listening on " << socket_path_;
+
+  while (true) {
+    struct pollfd fds[2];
+    fds[0].fd = listen_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = data_->watcher.fd();
+    fds[1].events = POLLIN;
+    int count = data_->watcher.enabled() ? 2 : 1;
+    if (poll(fds, count, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG(ERROR) << "poll() failed: " << strerror(errno);
+      close(listen_fd);
+      return false;
+    }
+    if (count > 1 && fds[1].revents != 0) {
+      ProcessEvents();
+    }
+    if (fds[0].revents & POLLIN) {
+      int client = accept(listen_fd, NULL, NULL);
+      if (client >= 0) {
+        HandleClient(client);
+        close(client);
+      }
+    }
+  }
+}
+
+void BuildServer::HandleClient(int fd) {
+  string request;
+  if (!ReadAll(fd, &request)) {
+    return;
+  }
+  vector<string> fields = SplitFields(request);
+  string error;
+  if (fields.size() < 3 ||
+      fields.size() < 3 + strtoul(fields[2].c_str(), NULL, 10)) {
+    error = "Malformed request.";
+  } else if (fields[0] != strings::CurrentPath()) {
+    // Not our tree, no response makes the client generate locally.
+    LOG(INFO) << "Ignoring request from " << fields[0];
+    return;
+  } else if (Generate(fields, &error)) {
+    WriteAll(fd, kOk);
+    return;
+  }
+  WriteAll(fd, kError + error);
+}
+
+bool BuildServer::Generate(const vector<string>& request, string* error) {
+  ProcessEvents();
+  if (!data_->watcher.enabled()) {
+    ResetCaches();
+  }
+  if (!data_->build_cache.Revalidate(error)) {
+    return false;
+  }
+
+  string key = strings::JoinAll(request, "\n");
+  if (!data_->dirty && key == data_->last_request) {
+    VLOG(1) << "No relevant changes, reusing makefile.";
+    Input input;
+    file::WriteFileOrDie(strings::JoinPath(input.root_dir(), request[1]),
+                         data_->last_makefile);
+    return true;
+  }
+
+  // Generate in a child, so that anything fatal (a bad BUILD file, an
+  // unknown rule, a bad client flag) is reported to the client rather than
+  // taking the server down. The child's stderr is the error message.
+  int out[2], err[2];
+  if (pipe(out) != 0) {
+    *error = strings::Join("pipe() failed: ", strerror(errno));
+    return false;
+  }
+  if (pipe(err) != 0) {
+    *error = strings::Join("pipe() failed: ", strerror(errno));
+    close(out[0]);
+    close(out[1]);
+    return false;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(out[0]);
+    close(err[0]);
+    dup2(err[1], STDERR_FILENO);
+    close(err[1]);
+    GenerateInChild(request, out[1]);
+  }
+  close(out[1]);
+  close(err[1]);
+  if (pid < 0) {
+    *error = strings::Join("fork() failed: ", strerror(errno));
+    close(out[0]);
+    close(err[0]);
+    return false;
+  }
+  string result, messages;
+  ReadPipes(out[0], err[0], &result, &messages);
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    *error = messages.empty() ? "Generation failed." : messages;
+    return false;
+  }
+
+  // Cache what the child read, it is gone along with its copy of our caches.
+  vector<string> fields = SplitFields(result);
+  CHECK(!fields.empty());
+  for (auto it = fields.begin() + 1; it != fields.end(); ++it) {
+    if (it->empty()) {
+      continue;
+    }
+    const string name = it->substr(1);
+    if ((*it)[0] == kReadBuildFile) {
+      data_->build_cache.Preload(name);
+    } else if ((*it)[0] == kReadGlob) {
+      data_->dist_source.InitializeForFile(name, NULL);
+    }
+  }
+  data_->build_cache.TakeRead();
+  data_->dist_source.TakeRead();
+  data_->last_makefile.swap(fields[0]);
+  data_->last_request = key;
+  data_->dirty = false;
+  return true;
+}
+
+void BuildServer::GenerateInChild(const vector<string>& request, int out_fd) {
+  // The client's flags, only for this request.
+  size_t num_flags = strtoul(request[2].c_str(), NULL, 10);
+  vector<char*> argv;
+  argv.push_back(const_cast<char*>("repobuild"));
+  for (size_t i = 0; i < num_flags; ++i) {
+    argv.push_back(const_cast<char*>(request[3 + i].c_str()));
+  }
+  int argc = argv.size();
+  char** argv_ptr = &argv[0];
+  google::ParseCommandLineNonHelpFlags(&argc, &argv_ptr, false);
+
+  vector<string> args(request.begin() + 3 + num_flags, request.end());
+  Input input;
+  parser_(args, &input);
+  Generator generator(&data_->dist_source);
+  generator.SetBuildFileCache(&data_->build_cache);
+  string result = generator.GenerateMakefile(input);
+  file::WriteFileOrDie(strings::JoinPath(input.root_dir(), request[1]),
+                       result);
+
+  result.push_back('\0');
+  for (const string& file : data_->build_cache.TakeRead()) {
+    result.append(1, kReadBuildFile).append(file).push_back('\0');
+  }
+  for (const string& glob : data_->dist_source.TakeRead()) {
+    result.append(1, kReadGlob).append(glob).push_back('\0');
+  }
+  _exit(WriteAll(out_fd, result) ? 0 : 1);
+}
+
+void BuildServer::ProcessEvents() {
+  vector<FileWatcher::Event> events;
+  if (!data_->watcher.ReadEvents(&events)) {
+    ResetCaches();
+    return;
+  }
+  for (const FileWatcher::Event& event : events) {
+    bool changed = data_->build_cache.Invalidate(event.path);
+    if (event.listing_changed) {
+      changed |= data_->dist_source.InvalidatePath(event.path);
+      // New directories and BUILD files can change :all/:allrec targets.
+      changed |= event.is_dir ||
+                 strings::PathBasename(event.path) == "BUILD";
+    }
+    if (changed) {
+      VLOG(1) << "Changed: " << event.path;
+      data_->dirty = true;
+    }
+  }
+}
+
+void BuildServer::ResetCaches() {
+  data_->build_cache.Clear();
+  data_->dist_source.Clear();
+  data_->dirty = true;
+}
+
+// static
+bool BuildServer::RemoteGenerate(const string& socket_path,
+                                 const string& makefile,
+                                 const vector<string>& flags,
+                                 const vector<string>& args,
+                                 bool* success) {
+  int fd = ConnectTo(socket_path);
+  if (fd < 0) {
+    return false;
+  }
+  string request;
+  request.append(strings::CurrentPath()).push_back('\0');
+  request.append(makefile).push_back('\0');
+  request.append(strings::StringPrintf("%d", static_cast<int>(flags.size()))).push_back('\0');
+  for (const string& flag : flags) {
+    request.append(flag).push_back('\0');
+  }
+  for (const string& arg : args) {
+    request.append(arg).push_back('\0');
+  }
+  string response;
+  bool ok = (WriteAll(fd, request) &&
+             shutdown(fd, SHUT_WR) == 0 &&
+             ReadAll(fd, &response));
+  close(fd);
+  if (!ok || response.empty()) {
+    // Server went away, let the caller generate the makefile itself.
+    return false;
+  }
+  if (response == kOk) {
+    *success = true;
+    return true;
+  }
+  if (strings::HasPrefix(response, kError)) {
+    LOG(ERROR) << response.substr(strlen(kError));
+    *success = false;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace repobuild
@@ -0,0 +1,75 @@
+// Copyright 2013
+// Author: Christopher Van Arsdale
+//
+// BuildServer
+//  Resident repobuild process. Keeps our DistSource (git tree state), the
+//  parsed BUILD files and glob results in memory between invocations, and
+//  uses inotify (linux only) to find out when any of them go stale. A thin
+//  client (repobuild --use_server) forwards its flags and arguments over a
+//  unix socket and the server writes the makefile. If nothing we read changed
+//  since the last identical request, the previous makefile is reused as-is.
+//
+//  Each makefile is generated in a forked child, which applies the client's
+//  flags and reports back what it read. Fatal errors (e.g. a bad BUILD file)
+//  only take down the child, and its stderr is returned to the client.
+//
+// Usage:
+//   repobuild --server &
+//   repobuild --use_server ":target"
+
+#ifndef _REPOBUILD_SERVER_BUILD_SERVER_H__
+#define _REPOBUILD_SERVER_BUILD_SERVER_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "common/base/macros.h"
+
+namespace repobuild {
+class DistSource;
+class Input;
+
+class BuildServer {
+ public:
+  // Fills in "input" from (non-gflag) command line arguments.
+  typedef void (*InputParser)(const std::vector<std::string>& args,
+                              Input* input);
+
+  BuildServer(const std::string& socket_path,
+              DistSource* source /* keeps reference */,
+              InputParser parser);
+  ~BuildServer();
+
+  // Serves requests until killed, returns false if we could not listen.
+  bool Run();
+
+  // Client side: asks the server listening on "socket_path" to write
+  // "makefile" for "args", using the command line "flags" (--flag=value).
+  // Returns false if no server handled the request, in which case the caller
+  // should generate the makefile itself. Otherwise "success" is set to the
+  // outcome of the generation.
+  static bool RemoteGenerate(const std::string& socket_path,
+                             const std::string& makefile,
+                             const std::vector<std::string>& flags,
+                             const std::vector<std::string>& args,
+                             bool* success);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BuildServer);
+
+  void HandleClient(int fd);
+  bool Generate(const std::vector<std::string>& request, std::string* error);
+  void GenerateInChild(const std::vector<std::string>& request,
+                       int out_fd);  // never returns.
+  void ProcessEvents();
+  void ResetCaches();
+
+  struct ServerData;
+  std::string socket_path_;
+  InputParser parser_;
+  std::unique_ptr<ServerData> data_;
+};
+
+}  // namespace repobuild
+
+#endif  // _REPOBUILD_SERVER_BUILD_SERVER_H__